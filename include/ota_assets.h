@@ -0,0 +1,43 @@
+#pragma once
+
+#include <Arduino.h>
+
+// --- Compressed Embedded Assets ---
+/*
+* Static files (web UI, certificates, lookup tables) placed in the `assets/` folder are
+* compiled into the firmware by `scripts/embed_assets.py`, compressed with deflate.
+* Why: Plain rodata is downloaded again with every OTA release and takes flash space.
+*      Stored compressed, both shrink. The saving shows up in releases/perf.json.
+* How:
+*   1. assetGet() looks the asset up by its path inside assets/ (e.g. "web/index.html").
+*   2. Uncompressed assets (compression did not save at least 10% and 1 KB) are returned straight
+*      from flash.
+*   3. Compressed assets are decompressed at first use with the inflater in the ESP32 ROM
+*      and kept in a small RAM cache of `OTA_ASSET_CACHE_BYTES`. When the cache is full,
+*      the least recently used assets are freed.
+* A pointer from assetGet() stays valid until the next assetGet() call, which may evict it.
+* Copy the data if you need it longer, or use assetRead() with your own buffer.
+* The cache is not locked, so only use these functions from one task.
+*/
+
+// RAM kept for decompressed assets. Override with -D OTA_ASSET_CACHE_BYTES=N.
+#ifndef OTA_ASSET_CACHE_BYTES
+#define OTA_ASSET_CACHE_BYTES 8192
+#endif
+
+// One entry of the generated asset table
+struct OtaAssetEntry {
+    const char* name;
+    const uint8_t* data;
+    uint32_t storedSize;
+    uint32_t size;       // size after decompression
+    bool compressed;
+};
+
+// Returns the asset's contents and sets `size`, or returns NULL if there is no such asset
+// or not enough RAM to decompress it.
+const uint8_t* assetGet(const char* name, size_t* size);
+
+// Decompresses the asset into `buffer`, bypassing the cache. Returns its size, or 0 if the
+// asset does not exist or does not fit in `bufferSize` bytes.
+size_t assetRead(const char* name, uint8_t* buffer, size_t bufferSize);
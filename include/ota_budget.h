@@ -0,0 +1,87 @@
+#pragma once
+
+#include <Arduino.h>
+
+// --- Data Budget for Metered Links ---
+/*
+* Devices behind cellular routers pay for every byte. A version poll costs a few KB
+* (mostly the TLS handshake), which at one poll every 30 seconds adds up to ~20 MB a month.
+* Why: Count what the updater downloads against a daily and a monthly budget, and fall
+*      back to cheaper behaviour before the cap is reached.
+* How:
+*   1. Every version check and firmware download reports its body size with budgetRecord().
+*      The module adds an estimate for the TLS handshake, headers and TCP/IP framing.
+*   2. The counters are kept in NVS (Preferences), so a reboot does not reset them. Checks
+*      are saved every BUDGET_SAVE_EVERY calls to spare the flash; a reset can lose that many.
+*      With no budget configured nothing is written at all.
+*   3. The day and month come from the HTTP `Date` header of the version check or firmware
+*      download, so no NTP traffic is needed. LAN followers, which rarely check themselves,
+*      also hear the leader's day, but only accept it as the day after their own last `Date`
+*      header once their own clock has reached it (budgetSetLeaderDay()). When the date
+*      changes the matching counter starts again at zero.
+*   4. budgetMode() tells the OTA task how to behave:
+*        BUDGET_NORMAL    - below `BUDGET_SAVER_PERCENT` of both budgets, behave as before.
+*        BUDGET_SAVER     - conditional version checks (If-None-Match), longer poll interval,
+*                           and a firmware download only if it fits in what is left.
+*        BUDGET_EXHAUSTED - no firmware downloads, and no checks until budgetResumeDelay()
+*                           says the day (or month) has rolled over.
+* A budget of 0 means "unlimited"; with both at 0 the module never leaves BUDGET_NORMAL.
+*/
+
+// Estimated cost of one HTTPS request on top of its body: TLS handshake with the
+// certificate chain (~5 KB for raw.githubusercontent.com), request and response
+// headers (~1 KB) and TCP connection setup/teardown.
+#define BUDGET_REQUEST_OVERHEAD 6500
+
+// TCP/IP and TLS record headers add roughly 5% to every body byte.
+#define BUDGET_FRAMING_PERCENT 5
+
+// Switch to BUDGET_SAVER once this share of the daily or monthly budget is used.
+#define BUDGET_SAVER_PERCENT 80
+
+// Version checks between two NVS writes of the counters.
+#define BUDGET_SAVE_EVERY 10
+
+// Extra wait after UTC midnight before checking again in BUDGET_EXHAUSTED (ms).
+#define BUDGET_ROLLOVER_MARGIN 60000
+
+enum BudgetMode {
+    BUDGET_NORMAL,
+    BUDGET_SAVER,
+    BUDGET_EXHAUSTED
+};
+
+enum BudgetKind {
+    BUDGET_CHECK,
+    BUDGET_UPDATE
+};
+
+// Loads the counters from NVS. Call once from setup().
+void budgetBegin(uint32_t dailyLimit, uint32_t monthlyLimit);
+
+// Feeds the HTTP `Date` header ("Sun, 18 Oct 2026 09:41:07 GMT") to roll the counters over.
+void budgetSetDate(const String& httpDate);
+
+// Feeds the day (YYYYMMDD) from a LAN leader's heartbeat (see ota_lan.h). Unauthenticated, so
+// it is only used to roll over to the day after the last `Date` header, and not before our
+// own clock gets there.
+void budgetSetLeaderDay(uint32_t leaderDay);
+
+// The current day as YYYYMMDD (UTC), 0 before the first `Date` header.
+uint32_t budgetDay();
+
+// Adds one request with `bodyBytes` of payload to the counters.
+void budgetRecord(BudgetKind kind, uint32_t bodyBytes);
+
+BudgetMode budgetMode();
+
+// In BUDGET_EXHAUSTED: milliseconds until the used-up budget starts again, i.e. the next UTC
+// day, or the 1st of next month when the monthly budget is used up. 0 if not exhausted or
+// no `Date` header has been seen since boot.
+unsigned long budgetResumeDelay();
+
+// True if downloading `bodyBytes` now stays within both budgets.
+bool budgetAllows(uint32_t bodyBytes);
+
+// Prints a one-line summary, e.g. "[Budget] mode=saver day=412000/500000 ...".
+void budgetReport();
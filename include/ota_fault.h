@@ -0,0 +1,50 @@
+#pragma once
+
+#include <Arduino.h>
+
+// --- Power-Loss Fault Injection (opt-in) ---
+/*
+* Build the `esp32doit-devkit-v1-faults` environment (it adds `-D OTA_FAULT_INJECT`) to
+* reset the ESP32 at chosen points of an update, as if the power had been cut.
+* Why: We want proof that an interrupted update never bricks the device, and to know how
+*      much download each interruption costs.
+* How:
+*   1. `OTA_FAULT_PLAN` is a comma separated list of cut points, one per boot:
+*        begin          right after `Update.begin()`, before any data is written
+*        write:<bytes>  after the sector holding byte <bytes> was erased and written
+*        end            image fully written, `Update.end()` not called yet
+*        activated      `Update.end()` done (new image active), before journalFinish()
+*        random         begin, write or end, with a random write offset
+*      A cut at `activated` leaves the new firmware running, so put it last (or publish
+*      another version before the next entry).
+*   2. The position in the plan is kept in NVS. Every cut moves to the next entry, so the
+*      device works through the whole plan over several reboots and then updates normally.
+*   3. After each reset the update journal (ota_journal.h) reports whether the device
+*      recovered and how many bytes have to be downloaded again.
+*   4. `scripts/fault_report.py` turns the serial log into a report.
+* The cut is an `ESP.restart()` between two finished operations: a sector that has been
+* erased and written completely, or an NVS commit that has completed. That is a state a real
+* power cut can leave behind, but not the only one. Never exercised here:
+*   - a torn sector: power lost during a sector erase or halfway through writing it
+*   - a torn NVS entry: power lost during an NVS write or commit (journal, plan index)
+* Both are left to the bootloader's image check and NVS's own recovery, which this build
+* does not test.
+*/
+
+enum FaultPoint {
+    FAULT_BEGIN,
+    FAULT_WRITE,
+    FAULT_END,
+    FAULT_ACTIVATED,
+    FAULT_POINT_COUNT
+};
+
+#ifdef OTA_FAULT_INJECT
+// Loads the current plan entry. Call once from setup(), before journalBegin().
+void faultBegin();
+// Cuts the power if the current plan entry matches. `written`/`total` are only used by FAULT_WRITE.
+void faultCheck(FaultPoint point, uint32_t written = 0, uint32_t total = 0);
+#else
+inline void faultBegin() {}
+inline void faultCheck(FaultPoint, uint32_t = 0, uint32_t = 0) {}
+#endif
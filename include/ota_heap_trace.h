@@ -0,0 +1,41 @@
+#pragma once
+
+// --- OTA Heap Tracing (opt-in) ---
+/*
+* Build the `esp32doit-devkit-v1-heaptrace` environment (it adds `-D OTA_HEAP_TRACE`)
+* to get a heap report for every phase of a version check or firmware update.
+* Why: Free-heap numbers tell us how much memory an update takes, but not who allocates it.
+* How:
+*   1. `ota_task()` and `performFirmwareUpdate()` wrap each phase (DNS, TLS, HTTP headers,
+*      body, Update) in otaTracePhaseStart()/otaTracePhaseEnd().
+*   2. When a phase ends we print its duration, the heap before/after it and the lowest
+*      free heap seen since boot.
+*   3. The environment links with `-Wl,--wrap=malloc` and friends, so every allocation and
+*      free made during the phase goes into a fixed-size record buffer together with its
+*      caller addresses, and is printed when the phase ends. This needs no special build of
+*      the Arduino core (its own heap tracer is switched off).
+*   4. `scripts/heap_trace_report.py` reads the serial log and resolves those addresses
+*      to functions with addr2line and firmware.elf.
+* Without the build flag every call below compiles to nothing.
+*/
+
+enum OtaPhase {
+    OTA_PHASE_DNS,
+    OTA_PHASE_TLS,
+    OTA_PHASE_HEADERS,
+    OTA_PHASE_BODY,
+    OTA_PHASE_UPDATE,
+    OTA_PHASE_COUNT
+};
+
+#ifdef OTA_HEAP_TRACE
+void otaTraceBegin(const char* operation);
+void otaTracePhaseStart(OtaPhase phase);
+void otaTracePhaseEnd();
+void otaTraceEnd();
+#else
+inline void otaTraceBegin(const char*) {}
+inline void otaTracePhaseStart(OtaPhase) {}
+inline void otaTracePhaseEnd() {}
+inline void otaTraceEnd() {}
+#endif
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <Arduino.h>
+
+// --- Update Journal ---
+/*
+* A small record in NVS that says which update is in progress and how far it got.
+* Why: If power is cut during an update, the ESP32 boots the old firmware again (the new
+*      partition is only activated by `Update.end()`), but nothing tells us that it happened
+*      or how much of the download was wasted.
+* How:
+*   1. journalStart() is called after `Update.begin()` succeeds: from/to version, image size.
+*   2. journalProgress() stores the number of bytes written every `JOURNAL_CHECKPOINT` bytes.
+*      After a real power cut the re-download figure is therefore rounded down to a
+*      checkpoint; fault injection saves the exact position before it cuts.
+*   3. journalFinish() records the outcome and the download speed. On success the entry
+*      stays open until the new firmware has booted.
+*   4. journalBegin() runs at boot and closes any open entry:
+*        - running the target version        -> the update completed
+*        - running the old version, state was "writing"  -> interrupted. The bytes written so far
+*          have to be downloaded again, because the updater always starts from byte 0
+*        - running the old version after a successful `Update.end()` -> rolled back
+*      Each case is printed as an "[OTA Recovery]" line (parsed by scripts/fault_report.py).
+*/
+
+// How often (in bytes written) the progress is saved. 64 KB is ~15 NVS writes per 1 MB image.
+#define JOURNAL_CHECKPOINT 65536
+
+enum JournalResult {
+    JOURNAL_NONE,         // no update since the journal was created
+    JOURNAL_OK,           // the last update booted
+    JOURNAL_FAILED,       // download or Update.end() failed, old firmware still running
+    JOURNAL_INTERRUPTED,  // reset/power loss while writing
+    JOURNAL_ROLLED_BACK   // new image was activated but the old one is running
+};
+
+// Checks for an update that did not finish before the last reset. Call once from setup().
+void journalBegin(const char* runningVersion);
+
+void journalStart(const char* fromVersion, const String& toVersion, uint32_t imageSize);
+void journalProgress(uint32_t written);
+// Stores `written` exactly, without waiting for the next checkpoint.
+void journalSaveProgress(uint32_t written);
+void journalFinish(bool success, uint32_t bytesPerSecond);
+
+JournalResult journalLastResult();
+// Download speed of the last update that got as far as journalFinish(), 0 if unknown.
+uint32_t journalLastThroughput();
+const char* journalResultName(JournalResult result);
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <Arduino.h>
+
+// --- Leader-Elected Polling per LAN Segment ---
+/*
+* With `lanLeaderElection` enabled in main.cpp, the devices on one subnet elect a single
+* leader. Only the leader polls versionUrl. It tells the others about new versions over
+* UDP broadcast.
+* Why: 200 devices polling every 30 s make 200 identical upstream requests. With a leader,
+*      upstream polling scales with the number of sites, not devices.
+* How (all messages are one UDP broadcast datagram on `lanPort`):
+*   "OTA1 LEADER <id> <version> <day>"
+*                                 sent by the leader every LAN_HEARTBEAT_MS, and right away
+*                                 when it learns a new version ("-" if it has none yet).
+*                                 <day> is its budget day (YYYYMMDD). Followers use it only to
+*                                 confirm the rollover their own clock expects (ota_budget.h).
+*   "OTA1 CLAIM <id>"             sent by a device that wants to become leader
+*   1. Every device starts as a follower. A follower that hears no heartbeat for
+*      LAN_LEADER_TIMEOUT_MS (plus a random delay of up to 1 s) becomes a candidate and
+*      sends CLAIM.
+*   2. A candidate that hears a CLAIM with a higher id, or any LEADER, goes back to following.
+*      If nobody objects within LAN_ELECTION_MS it becomes the leader.
+*   3. A leader answers every CLAIM with a heartbeat. If two leaders hear each other, the one
+*      with the lower id steps down.
+*   4. When the leader goes away, its heartbeats stop and the followers elect a new one.
+* The id is the factory MAC from eFuse, so the highest-MAC device wins a contested election.
+* A leader busy downloading a firmware image sends no heartbeats. If that takes longer than
+* the timeout, the followers elect a new leader in the meantime, which costs one extra check.
+* Followers still download the firmware itself from upstream, each after a random delay of
+* up to LAN_UPDATE_JITTER_MS, so a release does not hit the server with every device at once.
+*
+* The election trusts the LAN: messages are not authenticated. A forged heartbeat with a
+* high id wins every election and can stop upstream polling for the whole segment. Its
+* <day> cannot move a follower's data budget ahead of the follower's own clock. Nor can it
+* make a device install anything: an announcement only makes a follower run one version
+* check of its own against versionUrl. With `requireVersionTag` on, the image must also carry
+* the version tag it expects (ota_version_tag.h). Do not enable election on a network you do
+* not control.
+*/
+
+#define LAN_HEARTBEAT_MS 10000
+#define LAN_LEADER_TIMEOUT_MS 35000
+#define LAN_ELECTION_MS 2000
+#define LAN_UPDATE_JITTER_MS 60000
+
+// Opens the UDP port. Call once Wi-Fi is connected.
+void lanBegin(uint16_t port);
+
+// Handles incoming messages and timers. Call every few hundred milliseconds.
+void lanLoop();
+
+bool lanIsLeader();
+
+// Leader only: the version just fetched from upstream, to be shared with the followers.
+void lanAnnounce(const String& version);
+
+// Follower only: the newest version announced by the leader, once this device's random
+// update delay has passed. Empty while there is nothing to act on.
+String lanAnnouncedVersion();
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <Arduino.h>
+#include <mbedtls/md.h>
+
+// --- Signed Release Manifests ---
+/*
+* In gateway mode (`siteGatewayUrl` in main.cpp) the device talks plain HTTP to a trusted
+* gateway on the site, which does the TLS to upstream (scripts/ota_gateway.py). Without TLS
+* the device cannot trust the connection, so it trusts signatures instead:
+*     version=1.0.4
+*     seq=1792315267     (release counter, the signing time in seconds; only ever grows)
+*     size=931216
+*     sha256=5f1c...e2   (SHA-256 of firmware.bin, hex)
+*     sig=3045...        (ECDSA P-256 signature of all lines above, DER as hex)
+* Why: The TLS handshake and record decryption are the biggest CPU and heap cost of an update
+*      on small devices. The signature check costs one ECDSA verify per manifest and one
+*      SHA-256 over the image, with no session state held during the download.
+* How:
+*   1. scripts/sign_release.py writes releases/manifest.txt, signed with the release key.
+*   2. manifestVerify() checks the signature with the public key embedded from
+*      assets/ota_signing_key.pem (see ota_assets.h). No key embedded means no update.
+*   3. The image is hashed with Sha256Stream while `Update.writeStream()` writes it, and
+*      only activated if the hash matches the manifest.
+*   4. A signature only proves a manifest was released once, not that it is current. To stop
+*      an old release from being replayed, the highest `seq` accepted so far is kept in NVS
+*      and lower ones are rejected, and checkForUpdate() never installs a version that
+*      manifestVersionCompare() finds older than the running one.
+*/
+
+// Name of the public key in assets/
+#define MANIFEST_KEY_ASSET "ota_signing_key.pem"
+
+struct OtaManifest {
+    String version;
+    uint32_t seq;
+    uint32_t size;
+    uint8_t sha256[32];
+};
+
+// Parses `text` and checks its signature. Returns false (and prints why) if anything is wrong.
+// Also rejects a manifest whose `seq` is lower than one accepted before.
+bool manifestVerify(const String& text, OtaManifest& manifest);
+
+// Compares dotted versions numerically ("1.0.10" > "1.0.9"). Returns <0, 0 or >0.
+int manifestVersionCompare(const String& a, const String& b);
+
+// Passes a stream through unchanged and computes the SHA-256 of everything read from it.
+class Sha256Stream : public Stream {
+public:
+    explicit Sha256Stream(Stream& source);
+    ~Sha256Stream();
+
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t readBytes(char* buffer, size_t length) override;
+    size_t write(uint8_t) override;
+
+    // Writes the hash of everything read so far to `digest` (32 bytes).
+    void finish(uint8_t* digest);
+
+private:
+    Stream& source;
+    mbedtls_md_context_t context;
+};
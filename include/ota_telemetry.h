@@ -0,0 +1,29 @@
+#pragma once
+
+#include <Arduino.h>
+
+// --- Telemetry Piggybacked on Version Polls ---
+/*
+* Every version check carries a short summary of the device's state in an
+* `X-OTA-Telemetry` request header, e.g.
+*     id=a4cf12345678;v=1.0.3;r=ok;tp=48213;hm=118432;up=86400
+* Why: Sending reports and metrics as separate requests doubles the number of connections
+*      (and TLS handshakes). The version poll happens anyway, so the summary rides along for
+*      a few dozen bytes and no extra round trip.
+* Fields:
+*   id  device id (factory MAC from eFuse, as hex)
+*   v   running firmware version
+*   r   result of the last update (ok, failed, interrupted, rolled_back, none)
+*   tp  download speed of the last update in bytes/s
+*   hm  lowest free heap since boot in bytes
+*   up  uptime in seconds
+* The summary never exceeds `TELEMETRY_MAX_LENGTH` characters; a field that does not fit
+* whole is left out. A gateway (or any server that sees the request) can unpack it with
+* `scripts/telemetry.py`. It is off by default (`sendPollTelemetry` in main.cpp), because
+* GitHub ignores it and it carries the device's MAC.
+*/
+
+#define TELEMETRY_HEADER "X-OTA-Telemetry"
+#define TELEMETRY_MAX_LENGTH 96
+
+String telemetrySummary(const char* version);
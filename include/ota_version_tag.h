@@ -0,0 +1,48 @@
+#pragma once
+
+#include <Arduino.h>
+
+// --- Version Tag in the Firmware Image ---
+/*
+* Every image built from this project contains the string "OTA_FW_VERSION=<version>"
+* (with its terminating NUL), taken from FIRMWARE_VERSION.
+* Why: version.txt and a LAN announcement only say which version *should* be at
+*      firmwareUrl. A stale CDN copy, or a follower misled by a forged announcement, would
+*      otherwise flash whatever image it got, reboot, see the version still differs and
+*      download it again, forever.
+* How: performFirmwareUpdate() reads the download through a VersionTagStream, which looks
+*      for the expected tag while the image is written. With `requireVersionTag` on in
+*      main.cpp, `Update.end()` is only called if it was found; otherwise the written image
+*      is abandoned with `Update.abort()`.
+* Images built before the tag existed do not contain it and are refused while the switch is
+* on. It is off by default so that existing releases keep installing.
+*/
+
+#define OTA_VERSION_TAG_PREFIX "OTA_FW_VERSION="
+// Longest version string the tag can be matched for
+#define OTA_VERSION_TAG_MAX 48
+
+// Passes a stream through unchanged and watches for the version tag of `version`.
+class VersionTagStream : public Stream {
+public:
+    VersionTagStream(Stream& source, const String& version);
+
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t readBytes(char* buffer, size_t length) override;
+    size_t write(uint8_t) override;
+
+    // True once the tag of the expected version has been read.
+    bool found() const { return tagFound; }
+
+private:
+    void scan(uint8_t byte);
+
+    Stream& source;
+    uint8_t pattern[sizeof(OTA_VERSION_TAG_PREFIX) + OTA_VERSION_TAG_MAX];
+    uint8_t fallback[sizeof(OTA_VERSION_TAG_PREFIX) + OTA_VERSION_TAG_MAX];
+    size_t patternLength = 0;
+    size_t matched = 0;
+    bool tagFound = false;
+};
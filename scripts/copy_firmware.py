@@ -1,4 +1,5 @@
 import os
+import sys
 import shutil
 import glob
 
@@ -46,6 +47,18 @@ def after_build(source, target, env):
     # The .elf file contains debug symbols and is useful for advanced debugging.
     elf_path = os.path.join(build_dir, "firmware.elf")
 
+    # --- Remember the release we are about to replace ---
+    # The performance record (see below) needs it to estimate the size of a delta update.
+    previous_image = None
+    previous_version = None
+    previous_bin_path = os.path.join(releases_dir, "firmware.bin")
+    previous_version_path = os.path.join(releases_dir, "version.txt")
+    if os.path.isfile(previous_bin_path) and os.path.isfile(previous_version_path):
+        with open(previous_bin_path, "rb") as f:
+            previous_image = f.read()
+        with open(previous_version_path) as f:
+            previous_version = f.read().strip()
+
     copied = []
     # Check if the firmware.bin file actually exists before trying to copy it.
     if os.path.isfile(bin_path):
@@ -96,6 +109,45 @@ def after_build(source, target, env):
             "[copy_firmware] Warning: FIRMWARE_VERSION not found in build defines. version.txt not created."
         )
 
+    # --- Generate the performance record ---
+    # perf.json (and history/<version>.json) holds the image, compressed and delta sizes,
+    # and how much the compressed assets (embed_assets.py) save.
+    # If OTA_PERF_LOG points to a serial log of the heap tracing build, the update time
+    # and peak heap measured there are added too. Compare releases with:
+    #   python scripts/perf_history.py
+    if version and os.path.isfile(bin_path):
+        # extra_scripts run without __file__, so find perf_history.py through the project dir.
+        sys.path.insert(0, os.path.join(project_dir, "scripts"))
+        import perf_history
+
+        record = perf_history.build_record(
+            version,
+            bin_path,
+            previous_image,
+            previous_version,
+            os.environ.get("OTA_PERF_LOG"),
+            os.path.join(build_dir, "assets_report.json"),
+        )
+        copied.extend(perf_history.save_record(releases_dir, record))
+        print(
+            f"[copy_firmware] Performance record: {record['image_size']} bytes, "
+            f"{record['compressed_size']} compressed, delta from {record['delta_base']}: {record['delta_size']}"
+        )
+
+    # --- Sign the release for gateway mode ---
+    # manifest.txt lets devices behind a site gateway check the image without TLS
+    # (see include/ota_manifest.h). It needs the private key from:
+    #   python scripts/sign_release.py --genkey
+    if version and os.path.isfile(bin_path):
+        sys.path.insert(0, os.path.join(project_dir, "scripts"))
+        import sign_release
+
+        key_path = sign_release.signing_key_path(project_dir)
+        if os.path.isfile(key_path):
+            copied.append(sign_release.write_manifest(releases_dir, version, os.path.join(releases_dir, "firmware.bin"), key_path))
+        else:
+            print(f"[copy_firmware] No signing key at {key_path}, manifest.txt not created (only needed for gateway mode).")
+
     # Provide feedback in the terminal to confirm what was copied.
     if copied:
         print("\n[copy_firmware] Copied build artifacts:")
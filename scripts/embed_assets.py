@@ -0,0 +1,120 @@
+import json
+import os
+import zlib
+
+# This script is run by PlatformIO *before* the build (extra_scripts = pre:...).
+# It turns every file in the 'assets' folder (web UI files, certificates, lookup
+# tables, ...) into a C array in a generated header, compressed with raw deflate.
+# The firmware decompresses an asset the first time it is used (see include/ota_assets.h),
+# so both firmware.bin (the OTA download) and the flash footprint shrink.
+#
+# The header is written to $BUILD_DIR/generated/ota_assets_data.h, and the sizes
+# to $BUILD_DIR/assets_report.json, which copy_firmware.py adds to the release's
+# performance record.
+
+try:
+    from SCons.Script import Import  # type: ignore
+
+    Import("env")
+except Exception:
+    # Not running inside PlatformIO (e.g. opened in an editor)
+    env = None
+
+# An asset is only stored compressed if that saves at least this share of its size, and
+# at least MIN_SAVING_BYTES. Otherwise the decompression time and RAM (an ~11 KB inflate
+# state for every first read) are not worth it; a 178 byte PEM key would save 27 bytes.
+MIN_SAVING_PERCENT = 10
+MIN_SAVING_BYTES = 1024
+
+
+def collect_assets(assets_dir):
+    """
+    All files below assets/, by their path relative to it. README files are documentation,
+    and empty files would become zero-size C arrays, which the compiler rejects.
+    """
+    assets = []
+    for root, _, files in os.walk(assets_dir):
+        for name in sorted(files):
+            path = os.path.join(root, name)
+            if name.upper().startswith("README") or os.path.getsize(path) == 0:
+                continue
+            assets.append((os.path.relpath(path, assets_dir).replace(os.sep, "/"), path))
+    return sorted(assets)
+
+
+def compress(data):
+    """Raw deflate (no zlib header), which is what tinfl in the ESP32 ROM expects."""
+    compressor = zlib.compressobj(9, zlib.DEFLATED, -15)
+    return compressor.compress(data) + compressor.flush()
+
+
+def c_array(name, data):
+    lines = [f"static const uint8_t {name}[] = {{"]
+    for offset in range(0, len(data), 16):
+        lines.append("    " + ", ".join(f"0x{b:02x}" for b in data[offset:offset + 16]) + ",")
+    lines.append("};")
+    return "\n".join(lines)
+
+
+def generate(assets_dir, out_dir):
+    """Write the header and the size report. Returns the report."""
+    arrays, entries, report = [], [], {"assets": [], "raw_size": 0, "stored_size": 0}
+    for index, (name, path) in enumerate(collect_assets(assets_dir)):
+        with open(path, "rb") as f:
+            raw = f.read()
+        packed = compress(raw)
+        saving = len(raw) - len(packed)
+        compressed = saving >= MIN_SAVING_BYTES and saving * 100 >= len(raw) * MIN_SAVING_PERCENT
+        stored = packed if compressed else raw
+
+        arrays.append(c_array(f"asset_{index}", stored))
+        entries.append(f'    {{"{name}", asset_{index}, {len(stored)}, {len(raw)}, {"true" if compressed else "false"}}},')
+        report["assets"].append({"name": name, "raw_size": len(raw), "stored_size": len(stored)})
+        report["raw_size"] += len(raw)
+        report["stored_size"] += len(stored)
+
+    header = [
+        "// Generated by scripts/embed_assets.py from the files in assets/ - do not edit.",
+        "#pragma once",
+        "",
+    ]
+    header += arrays
+    header.append("")
+    header.append(f"#define OTA_ASSET_COUNT {len(entries)}")
+    if entries:
+        header.append("static const OtaAssetEntry otaAssetTable[OTA_ASSET_COUNT] = {")
+        header += entries
+        header.append("};")
+    header = "\n".join(header) + "\n"
+
+    os.makedirs(out_dir, exist_ok=True)
+    header_path = os.path.join(out_dir, "ota_assets_data.h")
+    # Only rewrite the header when it changed, so an unchanged asset folder does not
+    # trigger a rebuild.
+    old = None
+    if os.path.isfile(header_path):
+        with open(header_path) as f:
+            old = f.read()
+    if old != header:
+        with open(header_path, "w") as f:
+            f.write(header)
+    return report
+
+
+if env is not None:
+    project_dir = env["PROJECT_DIR"]
+    build_dir = env.subst("$BUILD_DIR")
+    generated_dir = os.path.join(build_dir, "generated")
+
+    report = generate(os.path.join(project_dir, "assets"), generated_dir)
+    with open(os.path.join(build_dir, "assets_report.json"), "w") as f:
+        json.dump(report, f, indent=2)
+
+    # Let the sources find the generated header
+    env.Append(CPPPATH=[generated_dir])
+
+    saved = report["raw_size"] - report["stored_size"]
+    print(
+        f"[embed_assets] {len(report['assets'])} assets: {report['raw_size']} bytes -> "
+        f"{report['stored_size']} bytes in the image (saved {saved})"
+    )
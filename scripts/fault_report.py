@@ -0,0 +1,86 @@
+import argparse
+import re
+import sys
+
+# This script reads the serial log of a fault injection run (the
+# 'esp32doit-devkit-v1-faults' environment) and reports, for every injected
+# power cut, whether the device recovered and how many bytes it had to
+# download again.
+#
+# Usage:
+#   1. Flash the faults build over USB and publish a newer version in releases/.
+#   2. pio device monitor -e esp32doit-devkit-v1-faults | tee faults.log
+#      (let it run until "[Fault] plan finished" and the update completes)
+#   3. python scripts/fault_report.py faults.log
+#
+# The exit code is 1 if any cut did not recover, so the run can gate a release.
+
+CUT_RE = re.compile(r"\[Fault\] cut (\d+) at point=(\S+) offset=(\d+)/(\d+)")
+INTERRUPTED_RE = re.compile(
+    r"\[OTA Recovery\] interrupted update (\S+) -> (\S+) at (\d+)/(\d+) bytes, running (\S+): recovered=(\d) redownload=(\d+)"
+)
+COMPLETED_RE = re.compile(r"\[OTA Recovery\] update (\S+) -> (\S+) completed, running (\S+): ok")
+ROLLED_BACK_RE = re.compile(r"\[OTA Recovery\] update (\S+) -> (\S+) rolled back, running (\S+): recovered=(\d)")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Report recovery from injected power cuts.")
+    parser.add_argument("log", help="serial log captured from a fault injection build")
+    args = parser.parse_args()
+
+    cuts = []
+    pending = None
+    completed = False
+    with open(args.log, errors="replace") as f:
+        for line in f:
+            m = CUT_RE.search(line)
+            if m:
+                index, point, offset, total = m.groups()
+                pending = {"cut": int(index), "point": point, "offset": int(offset), "total": int(total),
+                           "outcome": "no recovery report", "recovered": False, "redownload": 0}
+                cuts.append(pending)
+                continue
+
+            # A recovery line that follows a cut belongs to that cut. Without a pending cut
+            # it is a regular boot after an update.
+            m = INTERRUPTED_RE.search(line)
+            if m and pending:
+                pending["outcome"] = "interrupted, old firmware running"
+                pending["recovered"] = m.group(6) == "1"
+                # faultCheck() saves the exact offset to the journal before it cuts
+                pending["redownload"] = int(m.group(7))
+                pending = None
+                continue
+            m = COMPLETED_RE.search(line)
+            if m:
+                if pending:
+                    pending["outcome"] = "update had completed, new firmware running"
+                    pending["recovered"] = True
+                    pending = None
+                completed = True
+                continue
+            m = ROLLED_BACK_RE.search(line)
+            if m and pending:
+                pending["outcome"] = "rolled back"
+                pending["recovered"] = m.group(4) == "1"
+                pending = None
+
+    if not cuts:
+        print("No [Fault] cut lines found. Was the firmware built from the faults environment?")
+        sys.exit(1)
+
+    print(f"{'cut':>4}  {'point':<7}{'offset':>10}{'image':>10}  {'ok':<4}{'re-downloaded':>14}  outcome")
+    for c in cuts:
+        print(f"{c['cut']:>4}  {c['point']:<7}{c['offset']:>10}{c['total']:>10}  {'yes' if c['recovered'] else 'NO':<4}"
+              f"{c['redownload']:>14}  {c['outcome']}")
+
+    failed = [c for c in cuts if not c["recovered"]]
+    total = sum(c["redownload"] for c in cuts)
+    print(f"\n{len(cuts)} cuts, {len(cuts) - len(failed)} recovered, {total} bytes re-downloaded "
+          f"({total // len(cuts)} per cut on average)")
+    print("Final update completed." if completed else "Warning: no completed update after the last cut in this log.")
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,207 @@
+import argparse
+import glob
+import os
+import re
+import shutil
+import subprocess
+import sys
+from collections import defaultdict
+
+# This script turns the "[Heap Trace]" lines printed by a heap tracing build
+# (the 'esp32doit-devkit-v1-heaptrace' environment) into a per-phase report.
+#
+# Usage:
+#   pio device monitor | tee heap.log          # let it run through a check or an update
+#   python scripts/heap_trace_report.py heap.log
+#
+# The caller addresses in the allocation records are resolved with addr2line
+# against the firmware.elf of the heaptrace build, so we can see which functions
+# allocate the most. The addresses only mean something in the ELF that produced
+# the log, so there is no fallback to releases/firmware.elf.
+#
+# To compare two builds, e.g. direct HTTPS against a site gateway (see README,
+# 'Gateway Mode'), capture one log from each and run:
+#   python scripts/heap_trace_report.py https.log --compare gateway.log
+
+PHASE_RE = re.compile(
+    r"\[Heap Trace\] phase op=(\S+) phase=(\S+) ms=(\d+) heap_before=(\d+) heap_after=(\d+) low=(\d+) new_low=(\d)"
+)
+ALLOC_RE = re.compile(r"\[Heap Trace\] alloc op=(\S+) phase=(\S+) size=(\d+) freed=(\d) callers=(\S*)")
+OVERFLOW_RE = re.compile(r"\[Heap Trace\] overflow op=(\S+) phase=(\S+)")
+
+# Frames that belong to the allocator itself. We skip them so each allocation is
+# charged to the first caller that actually asked for memory.
+ALLOCATOR_FRAMES = ("heap_caps_", "multi_heap_", "malloc", "calloc", "realloc", "operator new", "_malloc_r",
+                    "_calloc_r", "_realloc_r", "mbedtls_calloc", "esp_mbedtls_mem_calloc")
+
+
+def default_elf(project_dir):
+    """The ELF of the heap tracing build, which is the one that produced the log."""
+    return os.path.join(project_dir, ".pio", "build", "esp32doit-devkit-v1-heaptrace", "firmware.elf")
+
+
+def find_addr2line():
+    """Look for the Xtensa addr2line on PATH, then in the PlatformIO toolchain folder."""
+    for name in ("xtensa-esp32-elf-addr2line", "xtensa-esp32s3-elf-addr2line"):
+        path = shutil.which(name)
+        if path:
+            return path
+    pattern = os.path.join(os.path.expanduser("~"), ".platformio", "packages", "toolchain-xtensa*", "bin",
+                           "xtensa-esp32*-elf-addr2line*")
+    matches = sorted(glob.glob(pattern))
+    return matches[0] if matches else None
+
+
+def resolve(addresses, elf, addr2line):
+    """Map each address to 'function (file:line)'. Returns the address itself if it cannot be resolved."""
+    names = {a: a for a in addresses}
+    if not addresses or not addr2line or not os.path.isfile(elf):
+        return names
+    ordered = sorted(addresses)
+    # One addr2line call for all addresses; -f prints the function, -C demangles C++ names.
+    out = subprocess.run([addr2line, "-f", "-C", "-e", elf] + ordered, capture_output=True, text=True).stdout
+    lines = out.splitlines()
+    for i, address in enumerate(ordered):
+        if 2 * i + 1 >= len(lines):
+            break
+        function, location = lines[2 * i], lines[2 * i + 1]
+        if function != "??":
+            names[address] = f"{function} ({os.path.basename(location)})"
+    return names
+
+
+def call_site(callers, names):
+    """The first frame that is not part of the allocator."""
+    for address in callers:
+        if not names[address].startswith(ALLOCATOR_FRAMES):
+            return names[address]
+    return names[callers[-1]] if callers else "<unknown>"
+
+
+def new_phase_stats():
+    return {"runs": 0, "ms": 0, "peak": 0, "retained": 0}
+
+
+def read_log(path):
+    """Returns (phases, allocs, overflows) parsed from one serial log."""
+    phases = defaultdict(new_phase_stats)
+    allocs = []
+    overflows = set()
+    with open(path, errors="replace") as f:
+        for line in f:
+            m = PHASE_RE.search(line)
+            if m:
+                op, phase, ms, before, after, low, new_low = m.groups()
+                stats = phases[(op, phase)]
+                stats["runs"] += 1
+                stats["ms"] += int(ms)
+                # Without a new low-water mark we only know the net change of the phase.
+                used = int(before) - (int(low) if new_low == "1" else min(int(before), int(after)))
+                stats["peak"] = max(stats["peak"], used)
+                stats["retained"] += int(before) - int(after)
+                continue
+            m = ALLOC_RE.search(line)
+            if m:
+                op, phase, size, freed, callers = m.groups()
+                allocs.append((op, phase, int(size), freed == "1", [c for c in callers.split(",") if c]))
+                continue
+            m = OVERFLOW_RE.search(line)
+            if m:
+                overflows.add(m.groups())
+    return phases, allocs, overflows
+
+
+def compare(base_path, base, other_path, other):
+    """Prints average time and peak heap of every phase in two logs side by side."""
+    print(f"A: {base_path}\nB: {other_path}\n")
+    print(f"{'op':<8}{'phase':<10}{'A ms':>8}{'B ms':>8}{'change':>9}{'A peak B':>11}{'B peak B':>11}{'change':>9}")
+    keys = list(base) + [k for k in other if k not in base]
+    totals = defaultdict(lambda: [0, 0, 0, 0])  # per op: A ms, B ms, A peak, B peak
+    for op, phase in keys:
+        a = base.get((op, phase), new_phase_stats())
+        b = other.get((op, phase), new_phase_stats())
+        a_ms = a["ms"] // a["runs"] if a["runs"] else 0
+        b_ms = b["ms"] // b["runs"] if b["runs"] else 0
+        print(f"{op:<8}{phase:<10}{a_ms:>8}{b_ms:>8}{percent(a_ms, b_ms):>9}{a['peak']:>11}{b['peak']:>11}"
+              f"{percent(a['peak'], b['peak']):>9}")
+        total = totals[op]
+        total[0] += a_ms
+        total[1] += b_ms
+        # Phases run one after another, so the worst phase is the peak of the whole operation
+        total[2] = max(total[2], a["peak"])
+        total[3] = max(total[3], b["peak"])
+    for op, (a_ms, b_ms, a_peak, b_peak) in totals.items():
+        print(f"{op:<8}{'total':<10}{a_ms:>8}{b_ms:>8}{percent(a_ms, b_ms):>9}{a_peak:>11}{b_peak:>11}"
+              f"{percent(a_peak, b_peak):>9}")
+
+
+def percent(a, b):
+    return f"{(b - a) * 100 / a:+.0f}%" if a else "-"
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Summarise [Heap Trace] serial output per OTA phase.")
+    parser.add_argument("log", help="serial log captured from a heap tracing build")
+    parser.add_argument("--elf", help="firmware.elf of the build that produced the log "
+                        "(default: .pio/build/esp32doit-devkit-v1-heaptrace/firmware.elf)")
+    parser.add_argument("--addr2line", help="path to xtensa-esp32-elf-addr2line")
+    parser.add_argument("--top", type=int, default=15, help="number of call sites to list (default 15)")
+    parser.add_argument("--compare", metavar="LOG", help="second log to compare per phase against the first")
+    args = parser.parse_args()
+
+    project_dir = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    elf = args.elf or default_elf(project_dir)
+    addr2line = args.addr2line or find_addr2line()
+
+    phases, allocs, overflows = read_log(args.log)
+    if not phases:
+        print("No [Heap Trace] lines found. Was the firmware built from the heaptrace environment?")
+        sys.exit(1)
+
+    if args.compare:
+        other, _, _ = read_log(args.compare)
+        if not other:
+            print(f"No [Heap Trace] lines found in {args.compare}.")
+            sys.exit(1)
+        compare(args.log, phases, args.compare, other)
+        return
+
+    print("Per-phase heap usage (averaged over runs, peak is the worst run)")
+    print(f"{'op':<8}{'phase':<10}{'runs':>6}{'avg ms':>10}{'peak B':>10}{'avg kept B':>12}")
+    for (op, phase), s in phases.items():
+        print(f"{op:<8}{phase:<10}{s['runs']:>6}{s['ms'] // s['runs']:>10}{s['peak']:>10}"
+              f"{s['retained'] // s['runs']:>12}")
+
+    if not allocs:
+        print("\nNo allocation records in the log. Was it built from the heaptrace environment")
+        print("(it links with -Wl,--wrap=malloc, see platformio.ini)?")
+        return
+
+    if not os.path.isfile(elf):
+        # Resolving against any other build would name the wrong functions
+        print(f"\n{elf} not found. Pass --elf with the firmware.elf of the build that produced the log.")
+        sys.exit(1)
+    names = resolve({c for a in allocs for c in a[4]}, elf, addr2line)
+    if not addr2line:
+        print("\nWarning: xtensa-esp32-elf-addr2line not found, addresses are not resolved (use --addr2line)")
+
+    sites = defaultdict(lambda: {"count": 0, "bytes": 0, "held": 0})
+    for op, phase, size, freed, callers in allocs:
+        site = sites[(phase, call_site(callers, names))]
+        site["count"] += 1
+        site["bytes"] += size
+        if not freed:
+            site["held"] += size
+
+    print(f"\nTop {args.top} call sites by bytes allocated")
+    print(f"{'phase':<10}{'allocs':>8}{'bytes':>10}{'not freed':>11}  call site")
+    ranked = sorted(sites.items(), key=lambda kv: kv[1]["bytes"], reverse=True)
+    for (phase, site), s in ranked[: args.top]:
+        print(f"{phase:<10}{s['count']:>8}{s['bytes']:>10}{s['held']:>11}  {site}")
+
+    for op, phase in sorted(overflows):
+        print(f"\nWarning: the record buffer filled up during {op}/{phase}; some allocations are missing.")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,174 @@
+import argparse
+import hashlib
+import http.server
+import os
+import ssl
+import sys
+import threading
+import time
+import urllib.request
+
+# Site gateway for devices in gateway mode (`siteGatewayUrl` in main.cpp).
+#
+# The gateway does the HTTPS to GitHub once for the whole site and serves the
+# devices over plain HTTP (or HTTPS with --cert/--key, if you want the LAN
+# traffic encrypted too):
+#
+#   GET /manifest.txt   the signed manifest (see scripts/sign_release.py)
+#   GET /firmware.bin   the image the manifest describes
+#
+# The gateway does not need to be trusted with integrity: devices check the
+# manifest signature and the image hash themselves. The gateway checks the hash
+# too, so it never caches or serves an image that devices would throw away.
+#
+# Usage:
+#   python scripts/ota_gateway.py                      # port 8080, GitHub releases upstream
+#   python scripts/ota_gateway.py --upstream http://localhost:8000/releases --port 8080
+#
+# The X-OTA-Telemetry header of every check is decoded and logged (see telemetry.py).
+
+DEFAULT_UPSTREAM = "https://raw.githubusercontent.com/KeenanKE/ESP32_OTA_Test/main/releases"
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import telemetry  # noqa: E402
+
+
+class ReleaseCache:
+    """
+    Holds the newest manifest and the image it points to. The manifest is fetched
+    again after `ttl` seconds; the image only when the manifest's sha256 changes.
+
+    Downloads run outside the lock, so a slow upstream never blocks requests that
+    the cache can answer; only the swap of the result happens under it. The ETag
+    of each body is computed once, when it is cached.
+    """
+
+    def __init__(self, upstream, ttl):
+        self.upstream = upstream.rstrip("/")
+        self.ttl = ttl
+        self.lock = threading.Lock()
+        self.manifest = None
+        self.manifest_etag = None
+        self.fetched_at = 0
+        self.image = None
+        self.image_etag = None
+        self.image_sha256 = None
+
+    def fetch(self, name):
+        request = urllib.request.Request(f"{self.upstream}/{name}", headers={"Cache-Control": "no-cache"})
+        with urllib.request.urlopen(request, timeout=30) as response:
+            return response.read()
+
+    @staticmethod
+    def etag(body):
+        return '"' + hashlib.sha256(body).hexdigest()[:16] + '"'
+
+    def get_manifest(self):
+        """Returns (manifest, etag), or (None, None) if there never was one."""
+        with self.lock:
+            fresh = self.manifest is not None and time.time() - self.fetched_at < self.ttl
+            if fresh:
+                return self.manifest, self.manifest_etag
+
+        try:
+            manifest = self.fetch("manifest.txt")
+        except OSError as e:
+            # Keep serving the last manifest while upstream is unreachable
+            print(f"[gateway] Manifest fetch failed: {e}")
+            with self.lock:
+                return self.manifest, self.manifest_etag
+
+        etag = self.etag(manifest)
+        with self.lock:
+            self.manifest, self.manifest_etag = manifest, etag
+            self.fetched_at = time.time()
+            return self.manifest, self.manifest_etag
+
+    def get_image(self):
+        """Returns (image, etag) for the current manifest, or (None, None)."""
+        manifest, _ = self.get_manifest()
+        if manifest is None:
+            return None, None
+        fields = dict(line.split("=", 1) for line in manifest.decode().splitlines() if "=" in line)
+        wanted = fields.get("sha256", "").lower()
+        with self.lock:
+            if self.image_sha256 == wanted:
+                return self.image, self.image_etag
+
+        # Several devices may miss the cache at once and each fetch the image; the
+        # results are identical, so the last one to finish simply wins.
+        image = self.fetch("firmware.bin")
+        actual = hashlib.sha256(image).hexdigest()
+        if actual != wanted:
+            # Usually upstream is halfway through publishing a release. Try again next time.
+            print(f"[gateway] firmware.bin ({actual[:12]}...) does not match the manifest ({wanted[:12]}...)")
+            return None, None
+        etag = '"' + actual[:16] + '"'
+        with self.lock:
+            if self.image_sha256 != actual:
+                self.image, self.image_etag, self.image_sha256 = image, etag, actual
+                print(f"[gateway] Cached firmware {fields.get('version')} ({len(image)} bytes)")
+        return image, etag
+
+
+class GatewayHandler(http.server.BaseHTTPRequestHandler):
+    cache = None
+
+    def do_GET(self):
+        summary = telemetry.decode(self.headers.get(telemetry.HEADER))
+        if summary:
+            print(f"[gateway] {self.client_address[0]} {summary}")
+
+        try:
+            if self.path == "/manifest.txt":
+                body, etag = self.cache.get_manifest()
+            elif self.path == "/firmware.bin":
+                body, etag = self.cache.get_image()
+            else:
+                self.send_error(404)
+                return
+        except OSError as e:
+            print(f"[gateway] Upstream error: {e}")
+            body = None
+        if body is None:
+            self.send_error(502, "Upstream not available")
+            return
+
+        # The devices send If-None-Match near their data cap (see ota_budget.h)
+        if self.headers.get("If-None-Match") == etag:
+            self.send_response(304)
+            self.send_header("ETag", etag)
+            self.end_headers()
+            return
+
+        self.send_response(200)
+        self.send_header("Content-Type", "application/octet-stream")
+        self.send_header("Content-Length", str(len(body)))
+        self.send_header("ETag", etag)
+        self.end_headers()
+        self.wfile.write(body)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Serve signed OTA releases to devices on this site.")
+    parser.add_argument("--upstream", default=DEFAULT_UPSTREAM, help="URL of the releases folder")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--ttl", type=int, default=30, help="seconds to reuse the manifest (default 30)")
+    parser.add_argument("--cert", help="certificate file, to serve HTTPS instead of HTTP")
+    parser.add_argument("--key", help="private key file for --cert")
+    args = parser.parse_args()
+
+    GatewayHandler.cache = ReleaseCache(args.upstream, args.ttl)
+    server = http.server.ThreadingHTTPServer(("", args.port), GatewayHandler)
+    scheme = "http"
+    if args.cert:
+        context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        context.load_cert_chain(args.cert, args.key)
+        server.socket = context.wrap_socket(server.socket, server_side=True)
+        scheme = "https"
+    print(f"[gateway] Serving {args.upstream} on {scheme}://0.0.0.0:{args.port}")
+    server.serve_forever()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,212 @@
+import argparse
+import glob
+import json
+import os
+import re
+import sys
+import zlib
+
+# Performance record for every release.
+#
+# copy_firmware.py calls build_record() and save_record() after each build, which
+# writes releases/perf.json (the current release) and releases/history/<version>.json
+# (kept for every version). Run this script before publishing to compare them:
+#
+#   python scripts/perf_history.py               # trend table, flags regressions
+#   python scripts/perf_history.py --threshold 3 # flag anything that grew by 3% or more
+#
+# The exit code is 1 if the newest release regressed against the one before it.
+
+# Fields compared between releases. For all of them, bigger is worse.
+METRICS = [
+    ("image_size", "image"),
+    ("compressed_size", "gzip"),
+    ("delta_size", "delta"),
+    ("assets_stored_size", "assets"),
+    ("update_time_ms", "upd ms"),
+    ("peak_heap_bytes", "peak heap"),
+]
+
+# Same format as the "[Heap Trace]" lines read by heap_trace_report.py
+BEGIN_RE = re.compile(r"\[Heap Trace\] begin op=update version=(\S+)")
+PHASE_RE = re.compile(
+    r"\[Heap Trace\] phase op=update phase=\S+ ms=(\d+) heap_before=(\d+) heap_after=(\d+) low=(\d+) new_low=(\d)"
+)
+END_RE = re.compile(r"\[Heap Trace\] end op=update")
+
+# Block size used for the delta estimate: one flash sector
+DELTA_BLOCK = 4096
+
+
+def version_key(version):
+    """'1.0.10' -> (1, 0, 10), so versions sort numerically."""
+    return tuple(int(p) if p.isdigit() else 0 for p in re.split(r"[.\-]", version))
+
+
+def delta_size(new, old):
+    """
+    Estimated size of a delta update from `old` to `new`: the compressed size of every
+    4 KB block that differs. This is what a block based delta would send. It is pessimistic,
+    because code that moves by a few bytes makes all the following blocks differ.
+    """
+    changed = bytearray()
+    for offset in range(0, len(new), DELTA_BLOCK):
+        block = new[offset:offset + DELTA_BLOCK]
+        if old[offset:offset + DELTA_BLOCK] != block:
+            changed += block
+    return len(zlib.compress(bytes(changed), 9))
+
+
+def update_stats(log_path):
+    """
+    Update time and peak heap of a firmware update, taken from the serial log of a heap
+    tracing build (see README, 'Heap Tracing'). A log can hold several updates, each
+    between "begin op=update" and "end op=update"; the time is their average and the
+    peak the worst of them. Returns (versions, time_ms, peak): `versions` is the set of
+    firmware versions that printed the updates, and the rest is None without an update.
+    """
+    versions, times, peak = set(), [], 0
+    current = None  # time of the update in progress
+    with open(log_path, errors="replace") as f:
+        for line in f:
+            m = BEGIN_RE.search(line)
+            if m:
+                versions.add(m.group(1))
+                current = 0
+                continue
+            m = PHASE_RE.search(line)
+            if m and current is not None:
+                ms, before, after, low, new_low = (int(g) for g in m.groups())
+                current += ms
+                peak = max(peak, before - (low if new_low else min(before, after)))
+                continue
+            if END_RE.search(line) and current is not None:
+                times.append(current)
+                current = None
+    if not times:
+        return versions, None, None
+    return versions, sum(times) // len(times), peak
+
+
+def build_record(version, bin_path, previous_image=None, previous_version=None, heap_log=None, assets_report=None):
+    """
+    Collect the performance record of one release. `previous_image` (bytes) and
+    `previous_version` describe the release it replaces and are used for the delta.
+    `assets_report` is the assets_report.json written by embed_assets.py.
+    """
+    with open(bin_path, "rb") as f:
+        image = f.read()
+
+    record = {
+        "version": version,
+        "image_size": len(image),
+        "compressed_size": len(zlib.compress(image, 9)),
+        "delta_base": None,
+        "delta_size": None,
+        "assets_raw_size": None,
+        "assets_stored_size": None,
+        "update_time_ms": None,
+        "peak_heap_bytes": None,
+    }
+
+    if previous_image and previous_version and previous_version != version:
+        record["delta_base"] = previous_version
+        record["delta_size"] = delta_size(image, previous_image)
+
+    # What the embedded assets would take uncompressed vs. what they take in the image
+    if assets_report and os.path.isfile(assets_report):
+        with open(assets_report) as f:
+            assets = json.load(f)
+        record["assets_raw_size"] = assets["raw_size"]
+        record["assets_stored_size"] = assets["stored_size"]
+
+    if heap_log and os.path.isfile(heap_log):
+        versions, update_time, peak = update_stats(heap_log)
+        # The log comes from a separate heaptrace build; numbers of another version would
+        # show up as that release's regression (or hide one).
+        if versions != {version}:
+            found = ", ".join(sorted(versions)) or "no version"
+            print(f"[perf_history] Warning: {heap_log} is from firmware {found}, not {version}. "
+                  "Update time and peak heap not recorded.")
+        else:
+            record["update_time_ms"], record["peak_heap_bytes"] = update_time, peak
+    return record
+
+
+def save_record(releases_dir, record):
+    """Write releases/perf.json and releases/history/<version>.json. Returns both paths."""
+    history_dir = os.path.join(releases_dir, "history")
+    os.makedirs(history_dir, exist_ok=True)
+    paths = [os.path.join(releases_dir, "perf.json"), os.path.join(history_dir, record["version"] + ".json")]
+
+    # Rebuilding a version replaces releases/ with itself, so there is no older image to diff
+    # against (and maybe no heap log). Keep what the earlier record of this version knew.
+    if os.path.isfile(paths[1]):
+        with open(paths[1]) as f:
+            earlier = json.load(f)
+        for key, value in earlier.items():
+            if record.get(key) is None and value is not None:
+                record[key] = value
+    for path in paths:
+        with open(path, "w") as f:
+            json.dump(record, f, indent=2)
+            f.write("\n")
+    return paths
+
+
+def load_history(releases_dir):
+    records = []
+    for path in glob.glob(os.path.join(releases_dir, "history", "*.json")):
+        with open(path) as f:
+            records.append(json.load(f))
+    return sorted(records, key=lambda r: version_key(r["version"]))
+
+
+def bar(value, largest, width=30):
+    return "#" * max(1, round(width * value / largest)) if largest else ""
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare performance records of all releases.")
+    parser.add_argument("--releases", default=os.path.join(os.path.dirname(os.path.dirname(os.path.abspath(__file__))),
+                                                           "releases"), help="releases folder (default: ./releases)")
+    parser.add_argument("--threshold", type=float, default=5.0,
+                        help="flag a metric that grew by this many percent or more (default 5)")
+    args = parser.parse_args()
+
+    records = load_history(args.releases)
+    if not records:
+        print("No records in", os.path.join(args.releases, "history"), "- build a release first.")
+        sys.exit(1)
+
+    print(f"{'version':<10}" + "".join(f"{label:>11}" for _, label in METRICS))
+    for r in records:
+        print(f"{r['version']:<10}" + "".join(f"{'-' if r.get(key) is None else r[key]:>11}" for key, _ in METRICS))
+
+    # Image size trend, the metric every record has
+    largest = max(r["image_size"] for r in records)
+    print("\nImage size")
+    for r in records:
+        print(f"{r['version']:<10}{bar(r['image_size'], largest)} {r['image_size']}")
+
+    # Flag every metric that grew by more than the threshold from one release to the next.
+    regressions = []
+    for previous, current in zip(records, records[1:]):
+        for key, label in METRICS:
+            old, new = previous.get(key), current.get(key)
+            if old and new is not None and (new - old) * 100.0 / old >= args.threshold:
+                regressions.append((previous["version"], current, label, old, new))
+
+    if regressions:
+        print(f"\nRegressions (>= {args.threshold:g}%):")
+        for base, current, label, old, new in regressions:
+            print(f"  {base} -> {current['version']}: {label} {old} -> {new} (+{(new - old) * 100.0 / old:.1f}%)")
+    else:
+        print(f"\nNo regressions >= {args.threshold:g}%.")
+
+    newest = records[-1]["version"]
+    sys.exit(1 if any(current["version"] == newest for _, current, _, _, _ in regressions) else 0)
+
+
+if __name__ == "__main__":
+    main()
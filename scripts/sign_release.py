@@ -0,0 +1,98 @@
+import argparse
+import hashlib
+import os
+import subprocess
+import sys
+import time
+
+# Signs releases for gateway mode (see include/ota_manifest.h).
+#
+# Devices that fetch updates over plain HTTP from a site gateway check a signed
+# manifest instead of relying on TLS. This script writes that manifest:
+#
+#   releases/manifest.txt
+#     version=1.0.4
+#     seq=1792315267   (signing time in seconds; devices refuse a seq lower than one seen before)
+#     size=931216
+#     sha256=<SHA-256 of firmware.bin, hex>
+#     sig=<ECDSA P-256 signature of the lines above, DER as hex>
+#
+# One-time setup (needs the openssl command line tool):
+#   python scripts/sign_release.py --genkey
+#     -> keys/ota_signing_key.pem    private key. Keep it secret, it is in .gitignore
+#     -> assets/ota_signing_key.pem  public key, compiled into the firmware
+#
+# After that, copy_firmware.py signs every build automatically. To sign by hand:
+#   python scripts/sign_release.py
+
+PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+DEFAULT_KEY = os.path.join(PROJECT_DIR, "keys", "ota_signing_key.pem")
+PUBLIC_KEY = os.path.join(PROJECT_DIR, "assets", "ota_signing_key.pem")
+
+
+def signing_key_path(project_dir=PROJECT_DIR):
+    """The private key: $OTA_SIGNING_KEY if set, else keys/ota_signing_key.pem."""
+    return os.environ.get("OTA_SIGNING_KEY") or os.path.join(project_dir, "keys", "ota_signing_key.pem")
+
+
+def generate_key(private_path=DEFAULT_KEY, public_path=PUBLIC_KEY):
+    if os.path.exists(private_path):
+        sys.exit(f"{private_path} already exists. Delete it first if you really want a new key.")
+    os.makedirs(os.path.dirname(private_path), exist_ok=True)
+    os.makedirs(os.path.dirname(public_path), exist_ok=True)
+    subprocess.run(["openssl", "ecparam", "-name", "prime256v1", "-genkey", "-noout", "-out", private_path],
+                   check=True)
+    subprocess.run(["openssl", "ec", "-in", private_path, "-pubout", "-out", public_path], check=True,
+                   capture_output=True)
+    print(f"Private key: {private_path}\nPublic key:  {public_path} (rebuild the firmware to embed it)")
+
+
+def build_manifest(version, image, seq=None):
+    """
+    The part of the manifest that gets signed. Every line ends with a newline. `seq` defaults
+    to the current time, so every release signed later gets a higher one.
+    """
+    seq = int(time.time()) if seq is None else seq
+    return f"version={version}\nseq={seq}\nsize={len(image)}\nsha256={hashlib.sha256(image).hexdigest()}\n"
+
+
+def sign(text, key_path):
+    """ECDSA P-256 over SHA-256 of `text`. Returns the DER signature as hex."""
+    result = subprocess.run(["openssl", "dgst", "-sha256", "-sign", key_path], input=text.encode(),
+                            capture_output=True, check=True)
+    return result.stdout.hex()
+
+
+def write_manifest(releases_dir, version, bin_path, key_path):
+    """Write releases/manifest.txt for `bin_path`. Returns its path."""
+    with open(bin_path, "rb") as f:
+        text = build_manifest(version, f.read())
+    text += f"sig={sign(text, key_path)}\n"
+    path = os.path.join(releases_dir, "manifest.txt")
+    with open(path, "w", newline="\n") as f:
+        f.write(text)
+    return path
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Sign releases/ for gateway mode.")
+    parser.add_argument("--genkey", action="store_true", help="create a new signing key pair")
+    parser.add_argument("--key", default=None, help="private key (default: $OTA_SIGNING_KEY or keys/ota_signing_key.pem)")
+    parser.add_argument("--releases", default=os.path.join(PROJECT_DIR, "releases"), help="releases folder")
+    args = parser.parse_args()
+
+    if args.genkey:
+        generate_key(args.key or DEFAULT_KEY)
+        return
+
+    key = args.key or signing_key_path()
+    if not os.path.isfile(key):
+        sys.exit(f"No signing key at {key}. Create one with --genkey.")
+    with open(os.path.join(args.releases, "version.txt")) as f:
+        version = f.read().strip()
+    path = write_manifest(args.releases, version, os.path.join(args.releases, "firmware.bin"), key)
+    print(f"Signed {version}: {path}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,60 @@
+import json
+import sys
+
+# Decoder for the X-OTA-Telemetry header that devices attach to every version
+# check (see include/ota_telemetry.h). A gateway or server that sees the request
+# calls decode() on the header value:
+#
+#   from telemetry import decode
+#   decode("id=a4cf12345678;v=1.0.3;r=ok;tp=48213;hm=118432;up=86400")
+#   -> {"id": "a4cf12345678", "version": "1.0.3", "last_result": "ok", ...}
+#
+# From the command line, each argument (or each line on stdin) is decoded into
+# one JSON object per line:
+#
+#   python scripts/telemetry.py "id=a4cf12345678;v=1.0.3;r=ok;tp=48213;hm=118432;up=86400"
+
+HEADER = "X-OTA-Telemetry"
+
+# Same limit as TELEMETRY_MAX_LENGTH on the device. Anything longer did not come from our firmware.
+MAX_LENGTH = 96
+
+# Short key on the wire -> (field name, type)
+FIELDS = {
+    "id": ("id", str),
+    "v": ("version", str),
+    "r": ("last_result", str),
+    "tp": ("throughput_bps", int),
+    "hm": ("heap_min", int),
+    "up": ("uptime_s", int),
+}
+
+
+def decode(value):
+    """
+    Unpack a telemetry header value into a dict. Unknown keys and fields that do not parse
+    are skipped, so older gateways keep working when the firmware adds fields.
+    """
+    if not value or len(value) > MAX_LENGTH:
+        return {}
+    summary = {}
+    for part in value.split(";"):
+        key, sep, raw = part.partition("=")
+        if not sep or key.strip() not in FIELDS:
+            continue
+        name, kind = FIELDS[key.strip()]
+        try:
+            summary[name] = kind(raw.strip())
+        except ValueError:
+            continue
+    return summary
+
+
+def main():
+    values = sys.argv[1:] or [line.strip() for line in sys.stdin if line.strip()]
+    for value in values:
+        print(json.dumps(decode(value)))
+
+
+if __name__ == "__main__":
+    main()
@@ -1,7 +1,16 @@
 #include <Arduino.h>
 #include <WiFi.h>
 #include <HTTPClient.h>
+#include <WiFiClientSecure.h>
 #include <Update.h>
+#include "ota_budget.h"
+#include "ota_fault.h"
+#include "ota_heap_trace.h"
+#include "ota_journal.h"
+#include "ota_lan.h"
+#include "ota_manifest.h"
+#include "ota_telemetry.h"
+#include "ota_version_tag.h"
 
 // --- Configuration ---
 // Replace with your Wi-Fi credentials
@@ -20,8 +29,134 @@ const int ledPin = 2;
 
 // Check for updates every 30 seconds
 const unsigned long updateInterval = 30000; 
+
+// Data budget for metered (e.g. cellular) links, in bytes. 0 means unlimited.
+// Near the cap the updater polls less often and only downloads firmware that fits (see ota_budget.h).
+const uint32_t dailyDataBudget = 0;
+const uint32_t monthlyDataBudget = 0;
+// In BUDGET_SAVER mode the check interval is multiplied by this factor (30 s -> 5 min)
+const unsigned long budgetSaverIntervalFactor = 10;
+// In BUDGET_EXHAUSTED mode the next check waits for the budget to roll over (see budgetResumeDelay()).
+// Until a server date is known, check once an hour instead.
+const unsigned long budgetExhaustedInterval = 3600000;
+// Attach a short state summary (version, last update result, ...) to every version check.
+// See ota_telemetry.h for the format. Turn it on when the checks go to a site gateway or your
+// own server; GitHub ignores it, and it would only hand out the device's MAC every 30 s.
+const bool sendPollTelemetry = false;
+
+// Elect one device per subnet to poll versionUrl for all of them (see ota_lan.h).
+// Turn this on when many devices share a LAN; every device on the segment must use the same port.
+const bool lanLeaderElection = false;
+const uint16_t lanPort = 47600;
+// How often the OTA task looks at LAN messages while leader election is on
+const unsigned long lanTickInterval = 250;
+
+// Fetch updates from a gateway on the site instead of GitHub, e.g. "http://192.168.1.10:8080"
+// (see ota_manifest.h and scripts/ota_gateway.py). Plain http skips TLS on the device; the
+// signed manifest protects the image. An https gateway URL works too. Empty means direct HTTPS.
+const char* siteGatewayUrl = "";
+
+// Only activate images that contain the tag "OTA_FW_VERSION=<version>" of the version being
+// installed (see ota_version_tag.h). Stops a stale CDN copy of firmware.bin from being flashed
+// over and over. Images built before the tag existed do not carry it and are refused, so only
+// turn this on once every release you still serve was built with it.
+const bool requireVersionTag = false;
 // --- End Configuration ---
 
+// ETag and content of the last version.txt we downloaded, for conditional checks in BUDGET_SAVER mode
+String versionEtag;
+String lastRemoteVersion;
+// The last manifest.txt that passed its signature check (gateway mode only)
+OtaManifest releaseManifest;
+
+bool gatewayMode() {
+    return siteGatewayUrl[0] != '\0';
+}
+
+// Counts a request against the data budget. Traffic to a site gateway stays on the LAN
+// (the gateway does the upstream download), so it is not counted.
+void recordTraffic(BudgetKind kind, uint32_t bodyBytes) {
+    if (!gatewayMode()) {
+        budgetRecord(kind, bodyBytes);
+    }
+}
+
+
+// --- Helper: Open an HTTP(S) GET in explicit steps ---
+/*
+* `beginTracedGet()`: Resolves the host, opens the connection and sends the GET request
+*                     as three separate steps, then leaves the response ready to be read.
+* Why: `http.GET()` after `http.begin(url)` does all three at once. Splitting them lets the
+*      heap tracer (see ota_heap_trace.h) attribute memory to DNS, TLS and the HTTP headers.
+* How:
+*   1. `WiFi.hostByName()` resolves the host. lwIP caches the answer, so the connect below
+*      does not do a second lookup.
+*   2. `client.connect()` opens the TCP connection (and does the TLS handshake when `client`
+*      is a WiFiClientSecure).
+*   3. `http.begin(client, url)` sees that the client is already connected and reuses it,
+*      so `http.GET()` only sends the request and reads the response headers.
+* If `ifNoneMatch` is set it is sent as `If-None-Match`, and the server answers
+* 304 Not Modified without a body when the file has not changed.
+* If `telemetry` is set it is sent in the `X-OTA-Telemetry` header (see ota_telemetry.h).
+* The `Date` and `ETag` response headers are kept and can be read with `http.header()`.
+* Returns the HTTP status code, or a negative HTTPC_ERROR_* code like `http.GET()` does.
+* A failed DNS lookup is printed here and returned as HTTPC_ERROR_CONNECTION_REFUSED.
+*/
+int beginTracedGet(HTTPClient& http, WiFiClient& client, const char* url, const String& ifNoneMatch = String(),
+                   const String& telemetry = String()) {
+    // Split "https://host[:port]/path" into host and port.
+    String host = url;
+    uint16_t port = host.startsWith("https://") ? 443 : 80;
+    host = host.substring(host.indexOf("://") + 3);
+    int pathStart = host.indexOf('/');
+    if (pathStart >= 0) {
+        host = host.substring(0, pathStart);
+    }
+    int portStart = host.indexOf(':');
+    if (portStart >= 0) {
+        port = host.substring(portStart + 1).toInt();
+        host = host.substring(0, portStart);
+    }
+
+    otaTracePhaseStart(OTA_PHASE_DNS);
+    IPAddress ip;
+    bool resolved = WiFi.hostByName(host.c_str(), ip) == 1;
+    otaTracePhaseEnd();
+    if (!resolved) {
+        // HTTPClient has no error code for a failed lookup, so say it here
+        Serial.printf("[OTA Task] DNS lookup for %s failed.\n", host.c_str());
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+    }
+
+    otaTracePhaseStart(OTA_PHASE_TLS);
+    bool connected = client.connect(host.c_str(), port);
+    otaTracePhaseEnd();
+    if (!connected) {
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+    }
+
+    otaTracePhaseStart(OTA_PHASE_HEADERS);
+    http.begin(client, url);
+
+    // Add cache-control headers to ensure we get the latest file instead of a CDN copy
+    http.addHeader("Cache-Control", "no-cache, no-store, must-revalidate");
+    http.addHeader("Pragma", "no-cache");
+    http.addHeader("Expires", "0");
+    if (ifNoneMatch.length() > 0) {
+        http.addHeader("If-None-Match", ifNoneMatch);
+    }
+    if (telemetry.length() > 0) {
+        http.addHeader(TELEMETRY_HEADER, telemetry);
+    }
+
+    const char* keepHeaders[] = {"Date", "ETag"};
+    http.collectHeaders(keepHeaders, 2);
+
+    int httpCode = http.GET();
+    otaTracePhaseEnd();
+    return httpCode;
+}
+
 
 // --- Function to Perform Firmware Update ---
 /*
@@ -29,47 +164,111 @@ const unsigned long updateInterval = 30000;
 * Why: By separating this from the version check, we only download the large firmware file
 *      when we know an update is actually available.
 * How: It downloads firmware.bin and writes it to the OTA partition using the Update library.
+*      Every step is recorded in the update journal (ota_journal.h), so an update that is
+*      cut short by a reset or power loss is detected and reported at the next boot.
+*      With `requireVersionTag` on, the image is only activated if it carries the version
+*      tag of `newVersion` (ota_version_tag.h). In gateway mode it is also hashed while it is written and
+*      only activated if size and SHA-256 match the signed manifest from the last check.
 */
-void performFirmwareUpdate() {
+void performFirmwareUpdate(const String& newVersion) {
     Serial.println("[OTA Update] Starting firmware download...");
-    
-    HTTPClient http;
-    http.begin(firmwareUrl);
+    otaTraceBegin("update");
 
-    // Add cache-control headers to ensure we get the latest firmware faster
-    http.addHeader("Cache-Control", "no-cache, no-store, must-revalidate");
-    http.addHeader("Pragma", "no-cache");
-    http.addHeader("Expires", "0");
+    HTTPClient http;
+    String url = gatewayMode() ? String(siteGatewayUrl) + "/firmware.bin" : String(firmwareUrl);
+    // No CA certificate is configured, so the server certificate is not verified.
+    // This is what `http.begin(url)` did for https URLs without a CA certificate.
+    WiFiClient plainClient;
+    WiFiClientSecure secureClient;
+    secureClient.setInsecure();
+    WiFiClient& client = url.startsWith("https://") ? secureClient : plainClient;
 
-    int httpCode = http.GET();
+    int httpCode = beginTracedGet(http, client, url.c_str());
+    if (httpCode > 0) {
+        budgetSetDate(http.header("Date"));
+    }
     if (httpCode == HTTP_CODE_OK) {
       // Get the size of the firmware
         int contentLength = http.getSize();
-        if (contentLength > 0) {
+        if (gatewayMode() && (!releaseManifest.version.equals(newVersion) || (uint32_t)contentLength != releaseManifest.size)) {
+            Serial.printf("[OTA Update] Firmware (%s, %d bytes) does not match the signed manifest (%s, %u bytes), skipping update.\n",
+                          newVersion.c_str(), contentLength, releaseManifest.version.c_str(), releaseManifest.size);
+        } else if (contentLength > 0 && !gatewayMode() && !budgetAllows(contentLength)) {
+            // We have no delta images, so a full download that does not fit has to wait
+            // for the next day or month.
+            Serial.printf("[OTA Update] Firmware (%d bytes) does not fit in the data budget, postponing update.\n", contentLength);
+            recordTraffic(BUDGET_UPDATE, 0);
+        } else if (contentLength > 0) {
             Serial.printf("[OTA Update] Firmware size: %d bytes\n", contentLength);
           // Begin the update process
+            otaTracePhaseStart(OTA_PHASE_UPDATE);
             bool canBegin = Update.begin(contentLength);
+            otaTracePhaseEnd();
             if (canBegin) {
+                journalStart(currentVersion, newVersion, contentLength);
+                faultCheck(FAULT_BEGIN);
+
+                // Called after each chunk is written to flash
+                Update.onProgress([](size_t done, size_t total) {
+                    journalProgress(done);
+                    faultCheck(FAULT_WRITE, done, total);
+                });
+
                 Serial.println("[OTA Update] Writing firmware to flash...");
                 WiFiClient& stream = http.getStream();
-                size_t written = Update.writeStream(stream);
+                VersionTagStream taggedStream(stream, newVersion);
+                Sha256Stream hashedStream(taggedStream);
+                otaTracePhaseStart(OTA_PHASE_BODY);
+                unsigned long writeStart = millis();
+                size_t written = Update.writeStream(gatewayMode() ? (Stream&)hashedStream : taggedStream);
+                unsigned long writeMs = millis() - writeStart;
+                otaTracePhaseEnd();
+                uint32_t bytesPerSecond = writeMs > 0 ? (uint64_t)written * 1000 / writeMs : 0;
+                recordTraffic(BUDGET_UPDATE, written);
               // Check if the write was successful
                 if (written == contentLength) {
                     Serial.println("[OTA Update] Wrote: " + String(written) + " bytes successfully");
                 } else {
                     Serial.println("[OTA Update] Wrote only: " + String(written) + "/" + String(contentLength) + " bytes. Error!");
                 }
+                // Never boot an image that is not the version we asked for, or (in gateway
+                // mode) that we cannot prove came from the release key
+                const char* rejected = NULL;
+                if (requireVersionTag && written == (size_t)contentLength && !taggedStream.found()) {
+                    rejected = "does not carry its version tag";
+                } else if (gatewayMode()) {
+                    uint8_t digest[32];
+                    hashedStream.finish(digest);
+                    if (memcmp(digest, releaseManifest.sha256, sizeof(digest)) != 0) {
+                        rejected = "SHA-256 does not match the signed manifest";
+                    }
+                }
               // Finalize the update
-                if (Update.end()) {
+                faultCheck(FAULT_END, written, contentLength);
+                bool ended = false;
+                if (rejected == NULL) {
+                    otaTracePhaseStart(OTA_PHASE_UPDATE);
+                    ended = Update.end();
+                    otaTracePhaseEnd();
+                }
+                if (rejected != NULL) {
+                    Serial.printf("[OTA Update] Firmware %s %s, discarding it.\n", newVersion.c_str(), rejected);
+                    Update.abort();
+                    journalFinish(false, bytesPerSecond);
+                } else if (ended) {
                     Serial.println("[OTA Update] Update finished!");
+                    faultCheck(FAULT_ACTIVATED, written, contentLength);
+                    journalFinish(Update.isFinished(), bytesPerSecond);
                     if (Update.isFinished()) {
                         Serial.println("[OTA Update] Update successful! Rebooting...");
+                        otaTraceEnd();
                         ESP.restart();
                     } else {
                         Serial.println("[OTA Update] Update not finished. Something went wrong.");
                     }
                 } else {
                     Serial.println("[OTA Update] Error occurred: " + String(Update.getError()));
+                    journalFinish(false, bytesPerSecond);
                 }
             } else {
                 Serial.println("[OTA Update] Not enough space to begin OTA");
@@ -79,8 +278,114 @@ void performFirmwareUpdate() {
         }
     } else {
         Serial.printf("[OTA Update] Firmware download failed. Error: %s\n", http.errorToString(httpCode).c_str());
+        if (httpCode > 0) {
+            recordTraffic(BUDGET_UPDATE, 0);
+        }
+    }
+    http.end();
+    otaTraceEnd();
+}
+
+
+// --- Version Check ---
+/*
+* `checkForUpdate()`: Downloads version.txt once and starts an update if it differs.
+* Why: ota_task() calls it on its own schedule, or only on the elected leader when
+*      LAN leader election is on.
+* How: It downloads the small version.txt file and only calls performFirmwareUpdate()
+*      if a new version is detected. A leader also announces the version on the LAN.
+*      In gateway mode it downloads manifest.txt instead and takes the version from it,
+*      but only after its signature checks out (see ota_manifest.h).
+*/
+void checkForUpdate() {
+    Serial.println("[OTA Task] Checking for new version...");
+    otaTraceBegin("check");
+
+    HTTPClient http;
+    String url = gatewayMode() ? String(siteGatewayUrl) + "/manifest.txt" : String(versionUrl);
+    WiFiClient plainClient;
+    WiFiClientSecure secureClient;
+    secureClient.setInsecure();
+    WiFiClient& client = url.startsWith("https://") ? secureClient : plainClient;
+
+    // Near the data cap, ask the server to skip the body if version.txt has not changed
+    String etag = budgetMode() == BUDGET_NORMAL ? String() : versionEtag;
+    String telemetry = sendPollTelemetry ? telemetrySummary(currentVersion) : String();
+    int httpCode = beginTracedGet(http, client, url.c_str(), etag, telemetry);
+    if (httpCode > 0) {
+        budgetSetDate(http.header("Date"));
+    }
+
+    if (httpCode == HTTP_CODE_OK || httpCode == HTTP_CODE_NOT_MODIFIED) {
+        String remoteVersion;
+        if (httpCode == HTTP_CODE_OK) {
+            otaTracePhaseStart(OTA_PHASE_BODY);
+            remoteVersion = http.getString();
+            recordTraffic(BUDGET_CHECK, remoteVersion.length());
+            if (gatewayMode()) {
+                OtaManifest manifest;
+                bool verified = manifestVerify(remoteVersion, manifest);
+                otaTracePhaseEnd();
+                if (!verified) {
+                    http.end();
+                    otaTraceEnd();
+                    budgetReport();
+                    return;
+                }
+                releaseManifest = manifest;
+                remoteVersion = manifest.version;
+            } else {
+                otaTracePhaseEnd();
+            }
+            remoteVersion.trim(); // Remove any leading/trailing whitespace
+            versionEtag = http.header("ETag");
+            lastRemoteVersion = remoteVersion;
+        } else {
+            recordTraffic(BUDGET_CHECK, 0);
+            remoteVersion = lastRemoteVersion;
+            Serial.printf("[OTA Task] %s not modified since the last check.\n", gatewayMode() ? "manifest.txt" : "version.txt");
+        }
+        Serial.printf("[OTA Task] Current version: %s, Remote version: %s\n", currentVersion, remoteVersion.c_str());
+
+        // Tell the followers before we (possibly) restart into the new version
+        lanAnnounce(remoteVersion);
+
+        // Compare the current version with the remote version
+        if (remoteVersion.equals(currentVersion)) {
+            Serial.println("[OTA Task] Firmware is up to date.");
+        } else if (gatewayMode() && manifestVersionCompare(remoteVersion, currentVersion) < 0) {
+            // An old signed manifest replayed by the gateway or someone on the LAN
+            Serial.printf("[OTA Task] Manifest offers %s, older than the running %s. Refusing to downgrade.\n",
+                          remoteVersion.c_str(), currentVersion);
+        } else if (budgetMode() == BUDGET_EXHAUSTED) {
+            Serial.println("[OTA Task] New firmware version available, but the data budget is used up.");
+        } else {
+            Serial.println("[OTA Task] New firmware version available! Starting update...");
+            http.end(); // Close the version check connection before starting firmware download
+            client.stop(); // Free the TLS session so the download has the heap to itself
+            otaTraceEnd();
+            performFirmwareUpdate(remoteVersion);
+        }
+    } else {
+        Serial.printf("[OTA Task] Version check failed. HTTP code: %d, Error: %s\n", httpCode, http.errorToString(httpCode).c_str());
+        if (httpCode > 0) {
+            recordTraffic(BUDGET_CHECK, 0);
+        }
     }
     http.end();
+    otaTraceEnd();
+    budgetReport();
+}
+
+// Time until the next check. On a metered link close to its cap we check less often.
+unsigned long nextCheckInterval() {
+    if (budgetMode() == BUDGET_SAVER) {
+        return updateInterval * budgetSaverIntervalFactor;
+    } else if (budgetMode() == BUDGET_EXHAUSTED) {
+        unsigned long resume = budgetResumeDelay();
+        return resume > 0 ? resume : budgetExhaustedInterval;
+    }
+    return updateInterval;
 }
 
 
@@ -97,41 +402,49 @@ void performFirmwareUpdate() {
 *   3. Only if a new version is detected does it call performFirmwareUpdate().
 *   4. `vTaskDelay()` is the FreeRTOS equivalent of `delay()`, but it properly yields
 *      CPU time to other tasks instead of halting the processor.
+*   5. With LAN leader election on, the task wakes up every `lanTickInterval` to handle
+*      LAN messages. Only the leader checks upstream. When the leader announces a version
+*      that differs from theirs, followers run one check of their own (LAN messages are
+*      not authenticated) and update if it confirms the new version.
 */
 void ota_task(void *parameter) {
+    unsigned long lastCheck = 0;
+    bool wasLeader = false;
+
     // The task runs in an infinite loop, checking for updates periodically.
     for (;;) {
-        Serial.println("[OTA Task] Checking for new version...");
+        if (!lanLeaderElection) {
+            checkForUpdate();
 
-        HTTPClient http;
-        http.begin(versionUrl);
-        
-        // Add cache-control headers to get the latest version file
-        http.addHeader("Cache-Control", "no-cache, no-store, must-revalidate");
-        http.addHeader("Pragma", "no-cache");
-        http.addHeader("Expires", "0");
-
-        int httpCode = http.GET();
-        if (httpCode == HTTP_CODE_OK) {
-            String remoteVersion = http.getString();
-            remoteVersion.trim(); // Remove any leading/trailing whitespace
-            Serial.printf("[OTA Task] Current version: %s, Remote version: %s\n", currentVersion, remoteVersion.c_str());
+            // Wait for the next update check. vTaskDelay is non-blocking for other tasks.
+            vTaskDelay(nextCheckInterval() / portTICK_PERIOD_MS);
+            continue;
+        }
 
-            // Compare the current version with the remote version
-            if (remoteVersion.equals(currentVersion)) {
-                Serial.println("[OTA Task] Firmware is up to date.");
-            } else {
-                Serial.println("[OTA Task] New firmware version available! Starting update...");
-                http.end(); // Close the version check connection before starting firmware download
-                performFirmwareUpdate();
+        lanLoop();
+        bool leader = lanIsLeader();
+        if (leader) {
+            // A newly elected leader checks right away, then on the normal schedule
+            if (!wasLeader || millis() - lastCheck >= nextCheckInterval()) {
+                checkForUpdate();
+                lastCheck = millis();
             }
         } else {
-            Serial.printf("[OTA Task] Version check failed. HTTP code: %d, Error: %s\n", httpCode, http.errorToString(httpCode).c_str());
+            // Followers stay quiet upstream until the leader announces a new version. Then one
+            // check of their own confirms it (and fetches the manifest in gateway mode) before
+            // anything is downloaded. If an update fails, retry on the normal schedule.
+            String announced = lanAnnouncedVersion();
+            if (announced.length() > 0 && !announced.equals(currentVersion) && budgetMode() != BUDGET_EXHAUSTED &&
+                (lastCheck == 0 || millis() - lastCheck >= nextCheckInterval())) {
+                Serial.printf("[OTA Task] Leader announced version %s (current %s). Confirming...\n",
+                              announced.c_str(), currentVersion);
+                checkForUpdate();
+                lastCheck = millis();
+            }
         }
-        http.end();
+        wasLeader = leader;
 
-        // Wait for the next update check. vTaskDelay is non-blocking for other tasks.
-        vTaskDelay(updateInterval / portTICK_PERIOD_MS);
+        vTaskDelay(lanTickInterval / portTICK_PERIOD_MS);
     }
 }
 
@@ -139,6 +452,10 @@ void setup() {
     Serial.begin(115200);
     Serial.println("\n[Boot] Starting up...");
 
+    // Report an update that was interrupted by the last reset (see ota_journal.h)
+    faultBegin();
+    journalBegin(currentVersion);
+
     // Initialize the built-in LED pin
     pinMode(ledPin, OUTPUT);
     digitalWrite(ledPin, LOW);
@@ -158,6 +475,13 @@ void setup() {
 
     digitalWrite(ledPin, LOW); // Turn LED off once connected
 
+    // Load the data counters before the first version check
+    budgetBegin(dailyDataBudget, monthlyDataBudget);
+
+    if (lanLeaderElection) {
+        lanBegin(lanPort);
+    }
+
     // --- Create OTA Task ---
     /*
     * `xTaskCreate`: This is a FreeRTOS function to create a new task.
@@ -0,0 +1,157 @@
+#include <Arduino.h>
+#include <esp32/rom/miniz.h>
+#include "ota_assets.h"
+
+// Generated by scripts/embed_assets.py. Builds without the script get an empty table.
+#if __has_include("ota_assets_data.h")
+#include "ota_assets_data.h"
+#else
+#define OTA_ASSET_COUNT 0
+#endif
+
+#if OTA_ASSET_COUNT > 0
+
+// Number of decompressed assets kept at the same time
+#define CACHE_SLOTS 4
+
+struct CacheSlot {
+    int asset;         // index in otaAssetTable, -1 if the slot is free
+    uint8_t* data;
+    uint32_t lastUse;
+};
+
+static CacheSlot cache[CACHE_SLOTS];
+static size_t cacheBytes = 0;
+static uint32_t useCounter = 0;
+static bool cacheReady = false;
+
+static int findAsset(const char* name) {
+    for (int i = 0; i < OTA_ASSET_COUNT; i++) {
+        if (strcmp(otaAssetTable[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool inflate(const OtaAssetEntry& asset, uint8_t* out) {
+    // The decompressor state is ~11 KB, too big for the task stack, so it lives on the heap
+    // only while we decompress.
+    tinfl_decompressor* decompressor = (tinfl_decompressor*)malloc(sizeof(tinfl_decompressor));
+    if (decompressor == NULL) {
+        return false;
+    }
+    tinfl_init(decompressor);
+    size_t inSize = asset.storedSize;
+    size_t outSize = asset.size;
+    tinfl_status status = tinfl_decompress(decompressor, asset.data, &inSize, out, out, &outSize,
+                                           TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF);
+    free(decompressor);
+    return status == TINFL_STATUS_DONE && outSize == asset.size;
+}
+
+static void evict(int slot) {
+    cacheBytes -= otaAssetTable[cache[slot].asset].size;
+    free(cache[slot].data);
+    cache[slot].asset = -1;
+    cache[slot].data = NULL;
+}
+
+// Returns a free slot, evicting the least recently used asset if needed.
+static int freeSlot() {
+    int oldest = 0;
+    for (int i = 0; i < CACHE_SLOTS; i++) {
+        if (cache[i].asset < 0) {
+            return i;
+        }
+        if (cache[i].lastUse < cache[oldest].lastUse) {
+            oldest = i;
+        }
+    }
+    evict(oldest);
+    return oldest;
+}
+
+const uint8_t* assetGet(const char* name, size_t* size) {
+    if (!cacheReady) {
+        for (int i = 0; i < CACHE_SLOTS; i++) {
+            cache[i].asset = -1;
+            cache[i].data = NULL;
+        }
+        cacheReady = true;
+    }
+
+    int index = findAsset(name);
+    if (index < 0) {
+        return NULL;
+    }
+    const OtaAssetEntry& asset = otaAssetTable[index];
+    if (!asset.compressed) {
+        *size = asset.size;
+        return asset.data;
+    }
+
+    for (int i = 0; i < CACHE_SLOTS; i++) {
+        if (cache[i].asset == index) {
+            cache[i].lastUse = ++useCounter;
+            *size = asset.size;
+            return cache[i].data;
+        }
+    }
+
+    // Too big to cache, the caller has to use assetRead() with its own buffer.
+    if (asset.size > OTA_ASSET_CACHE_BYTES) {
+        Serial.printf("[Assets] %s (%u bytes) is larger than the cache, use assetRead().\n", name,
+                      (unsigned)asset.size);
+        return NULL;
+    }
+
+    // Make room, oldest first
+    int slot = freeSlot();
+    while (cacheBytes + asset.size > OTA_ASSET_CACHE_BYTES) {
+        int oldest = -1;
+        for (int i = 0; i < CACHE_SLOTS; i++) {
+            if (cache[i].asset >= 0 && (oldest < 0 || cache[i].lastUse < cache[oldest].lastUse)) {
+                oldest = i;
+            }
+        }
+        evict(oldest);
+    }
+
+    uint8_t* data = (uint8_t*)malloc(asset.size);
+    if (data == NULL || !inflate(asset, data)) {
+        free(data);
+        return NULL;
+    }
+    cache[slot].asset = index;
+    cache[slot].data = data;
+    cache[slot].lastUse = ++useCounter;
+    cacheBytes += asset.size;
+    *size = asset.size;
+    return data;
+}
+
+size_t assetRead(const char* name, uint8_t* buffer, size_t bufferSize) {
+    int index = findAsset(name);
+    if (index < 0 || otaAssetTable[index].size > bufferSize) {
+        return 0;
+    }
+    const OtaAssetEntry& asset = otaAssetTable[index];
+    if (!asset.compressed) {
+        memcpy(buffer, asset.data, asset.size);
+        return asset.size;
+    }
+    return inflate(asset, buffer) ? asset.size : 0;
+}
+
+#else
+
+const uint8_t* assetGet(const char*, size_t*) {
+    return NULL;
+}
+
+size_t assetRead(const char*, uint8_t*, size_t) {
+    return 0;
+}
+
+#endif // OTA_ASSET_COUNT > 0
@@ -0,0 +1,206 @@
+#include <Arduino.h>
+#include <Preferences.h>
+#include "ota_budget.h"
+
+static Preferences budgetStore;
+
+static uint32_t dailyBudget = 0;
+static uint32_t monthlyBudget = 0;
+
+// Persisted state. `day` is YYYYMMDD (UTC) of the last `Date` header we saw, 0 if none yet.
+static uint32_t day = 0;
+static uint32_t dayBytes = 0;
+static uint32_t monthBytes = 0;
+static uint32_t checks = 0;
+static uint32_t updates = 0;
+
+static BudgetMode lastMode = BUDGET_NORMAL;
+static uint32_t unsavedChecks = 0;
+
+// Day and seconds since UTC midnight of the last `Date` header, and millis() when it arrived
+static bool timeKnown = false;
+static uint32_t dateDay = 0;
+static uint32_t dateSeconds = 0;
+static unsigned long dateMillis = 0;
+
+static bool budgetEnabled() {
+    return dailyBudget > 0 || monthlyBudget > 0;
+}
+
+static void save() {
+    // Without a budget the counters are only for budgetReport(); keep them out of flash.
+    if (!budgetEnabled()) {
+        return;
+    }
+    unsavedChecks = 0;
+    budgetStore.putUInt("day", day);
+    budgetStore.putUInt("dayBytes", dayBytes);
+    budgetStore.putUInt("monthBytes", monthBytes);
+    budgetStore.putUInt("checks", checks);
+    budgetStore.putUInt("updates", updates);
+}
+
+static bool over(uint32_t used, uint32_t limit, uint32_t percent) {
+    return limit > 0 && (uint64_t)used * 100 >= (uint64_t)limit * percent;
+}
+
+static uint32_t estimate(uint32_t bodyBytes) {
+    return BUDGET_REQUEST_OVERHEAD + bodyBytes + bodyBytes / 100 * BUDGET_FRAMING_PERCENT;
+}
+
+static uint32_t monthLength(uint32_t year, uint32_t month) {
+    static const uint8_t monthDays[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if (month == 2 && year % 4 == 0 && (year % 100 != 0 || year % 400 == 0)) {
+        return 29;
+    }
+    return monthDays[month - 1];
+}
+
+// YYYYMMDD of the day after `date`
+static uint32_t nextDay(uint32_t date) {
+    uint32_t year = date / 10000;
+    uint32_t month = date / 100 % 100;
+    if (date % 100 < monthLength(year, month)) {
+        return date + 1;
+    }
+    return month < 12 ? year * 10000 + (month + 1) * 100 + 1 : (year + 1) * 10000 + 101;
+}
+
+static void setDay(uint32_t today) {
+    uint32_t month = today / 100 % 100;
+    if (today < 20000101 || month < 1 || month > 12 || today % 100 < 1 || today % 100 > 31 || today == day) {
+        return;
+    }
+
+    // A new month also starts a new day. Dates going backwards (clock skew between CDN
+    // nodes) are ignored so the counters cannot be reset by a stale server.
+    if (today > day) {
+        if (today / 100 != day / 100) {
+            monthBytes = 0;
+        }
+        dayBytes = 0;
+        day = today;
+        save();
+    }
+}
+
+static const char* modeName(BudgetMode mode) {
+    switch (mode) {
+        case BUDGET_SAVER: return "saver";
+        case BUDGET_EXHAUSTED: return "exhausted";
+        default: return "normal";
+    }
+}
+
+void budgetBegin(uint32_t dailyLimit, uint32_t monthlyLimit) {
+    dailyBudget = dailyLimit;
+    monthlyBudget = monthlyLimit;
+    budgetStore.begin("ota_budget", false);
+    day = budgetStore.getUInt("day", 0);
+    dayBytes = budgetStore.getUInt("dayBytes", 0);
+    monthBytes = budgetStore.getUInt("monthBytes", 0);
+    checks = budgetStore.getUInt("checks", 0);
+    updates = budgetStore.getUInt("updates", 0);
+    lastMode = budgetMode();
+}
+
+void budgetSetDate(const String& httpDate) {
+    // RFC 7231 IMF-fixdate: "Sun, 18 Oct 2026 09:41:07 GMT"
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    if (httpDate.length() < 16 || httpDate.charAt(3) != ',') {
+        return;
+    }
+    uint32_t dayOfMonth = httpDate.substring(5, 7).toInt();
+    int monthIndex = String(months).indexOf(httpDate.substring(8, 11));
+    uint32_t year = httpDate.substring(12, 16).toInt();
+    if (dayOfMonth == 0 || monthIndex < 0 || monthIndex % 3 != 0 || year < 2000) {
+        return;
+    }
+    uint32_t today = year * 10000 + (monthIndex / 3 + 1) * 100 + dayOfMonth;
+
+    // "09:41:07" follows the year; it tells budgetResumeDelay() how far away midnight is.
+    if (httpDate.length() >= 25 && httpDate.charAt(19) == ':' && today >= day) {
+        dateSeconds = httpDate.substring(17, 19).toInt() * 3600 + httpDate.substring(20, 22).toInt() * 60 +
+                      httpDate.substring(23, 25).toInt();
+        dateMillis = millis();
+        dateDay = today;
+        timeKnown = true;
+    }
+    setDay(today);
+}
+
+void budgetSetLeaderDay(uint32_t leaderDay) {
+    // The heartbeat is not authenticated, so a LAN day alone never moves the counters. It is
+    // taken only as the day after our own last `Date` header, and only once our own clock
+    // says that day has (nearly) begun. A forged day can therefore start the new day at most
+    // BUDGET_ROLLOVER_MARGIN early, and never jump ahead.
+    if (!timeKnown || leaderDay == day || leaderDay != nextDay(dateDay)) {
+        return;
+    }
+    uint64_t sinceMidnight = (uint64_t)dateSeconds * 1000 + (millis() - dateMillis);
+    if (sinceMidnight + BUDGET_ROLLOVER_MARGIN >= 86400000) {
+        setDay(leaderDay);
+    }
+}
+
+void budgetRecord(BudgetKind kind, uint32_t bodyBytes) {
+    uint32_t cost = estimate(bodyBytes);
+    dayBytes += cost;
+    monthBytes += cost;
+    if (kind == BUDGET_CHECK) {
+        checks++;
+    } else {
+        updates++;
+    }
+
+    // A poll every 30 s would mean thousands of flash writes a day, so checks are saved in
+    // batches. Firmware downloads and mode changes are saved right away.
+    BudgetMode mode = budgetMode();
+    if (kind == BUDGET_UPDATE || mode != lastMode || ++unsavedChecks >= BUDGET_SAVE_EVERY) {
+        save();
+    }
+    if (mode != lastMode) {
+        Serial.printf("[Budget] Switching to %s mode.\n", modeName(mode));
+        lastMode = mode;
+    }
+}
+
+BudgetMode budgetMode() {
+    if (over(dayBytes, dailyBudget, 100) || over(monthBytes, monthlyBudget, 100)) {
+        return BUDGET_EXHAUSTED;
+    }
+    if (over(dayBytes, dailyBudget, BUDGET_SAVER_PERCENT) || over(monthBytes, monthlyBudget, BUDGET_SAVER_PERCENT)) {
+        return BUDGET_SAVER;
+    }
+    return BUDGET_NORMAL;
+}
+
+uint32_t budgetDay() {
+    return day;
+}
+
+unsigned long budgetResumeDelay() {
+    if (budgetMode() != BUDGET_EXHAUSTED || !timeKnown || day == 0) {
+        return 0;
+    }
+    // The daily budget is back at the next UTC midnight, the monthly one on the 1st
+    uint32_t daysLeft = 1;
+    if (over(monthBytes, monthlyBudget, 100)) {
+        daysLeft = monthLength(day / 10000, day / 100 % 100) - day % 100 + 1;
+    }
+    uint64_t untilRollover = (uint64_t)daysLeft * 86400000 - (uint64_t)dateSeconds * 1000;
+    uint64_t elapsed = millis() - dateMillis;
+    // Wait a little past midnight, so a server clock that is slightly behind agrees it is a new day
+    return elapsed < untilRollover ? untilRollover - elapsed + BUDGET_ROLLOVER_MARGIN : BUDGET_ROLLOVER_MARGIN;
+}
+
+bool budgetAllows(uint32_t bodyBytes) {
+    uint32_t cost = estimate(bodyBytes);
+    return !over(dayBytes + cost, dailyBudget, 100) && !over(monthBytes + cost, monthlyBudget, 100);
+}
+
+void budgetReport() {
+    Serial.printf("[Budget] mode=%s day=%u/%u month=%u/%u checks=%u updates=%u\n", modeName(budgetMode()),
+                  (unsigned)dayBytes, (unsigned)dailyBudget, (unsigned)monthBytes, (unsigned)monthlyBudget,
+                  (unsigned)checks, (unsigned)updates);
+}
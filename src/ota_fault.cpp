@@ -0,0 +1,93 @@
+#ifdef OTA_FAULT_INJECT
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "ota_fault.h"
+#include "ota_journal.h"
+
+// Cut points, one per boot. Override with -D OTA_FAULT_PLAN=\"...\" (see ota_fault.h).
+#ifndef OTA_FAULT_PLAN
+#define OTA_FAULT_PLAN "begin,write:4096,write:262144,end,random,random,random,activated"
+#endif
+
+static const char* const pointNames[FAULT_POINT_COUNT] = {"begin", "write", "end", "activated"};
+
+static Preferences faultStore;
+static uint32_t planIndex = 0;
+static bool armed = false;
+static FaultPoint armedPoint = FAULT_BEGIN;
+static uint32_t armedOffset = 0;
+static bool randomOffset = false;
+
+void faultBegin() {
+    faultStore.begin("ota_fault", false);
+    planIndex = faultStore.getUInt("index", 0);
+
+    // Find entry number `planIndex` in the plan.
+    String plan = OTA_FAULT_PLAN;
+    int start = 0;
+    for (uint32_t i = 0; i < planIndex && start >= 0; i++) {
+        start = plan.indexOf(',', start);
+        if (start >= 0) {
+            start++;
+        }
+    }
+    if (start < 0 || start >= (int)plan.length()) {
+        Serial.printf("[Fault] plan finished after %u cuts, updating normally.\n", (unsigned)planIndex);
+        return;
+    }
+    int stop = plan.indexOf(',', start);
+    String entry = plan.substring(start, stop < 0 ? plan.length() : stop);
+    entry.trim();
+
+    armed = true;
+    if (entry.equals("random")) {
+        // Not FAULT_ACTIVATED: a cut there leaves the new firmware running and ends the plan early
+        armedPoint = (FaultPoint)(esp_random() % FAULT_ACTIVATED);
+        randomOffset = true;  // picked once the image size is known
+    } else if (entry.startsWith("write:")) {
+        armedPoint = FAULT_WRITE;
+        armedOffset = entry.substring(6).toInt();
+    } else if (entry.equals("begin")) {
+        armedPoint = FAULT_BEGIN;
+    } else if (entry.equals("end")) {
+        armedPoint = FAULT_END;
+    } else if (entry.equals("activated")) {
+        armedPoint = FAULT_ACTIVATED;
+    } else {
+        Serial.printf("[Fault] unknown plan entry '%s', skipping it.\n", entry.c_str());
+        faultStore.putUInt("index", planIndex + 1);
+        armed = false;
+        return;
+    }
+    Serial.printf("[Fault] armed cut %u: %s\n", (unsigned)planIndex, entry.c_str());
+}
+
+void faultCheck(FaultPoint point, uint32_t written, uint32_t total) {
+    if (!armed || point != armedPoint) {
+        return;
+    }
+    if (point == FAULT_WRITE) {
+        if (randomOffset && total > 0) {
+            armedOffset = esp_random() % total;
+            randomOffset = false;
+        }
+        if (randomOffset || written <= armedOffset) {
+            return;
+        }
+    }
+
+    // Move on to the next plan entry before cutting, or we would cut at the same place forever.
+    faultStore.putUInt("index", planIndex + 1);
+    // The journal only saves every JOURNAL_CHECKPOINT bytes; give it the exact position so
+    // the recovery report shows what a cut here really costs.
+    if (written > 0) {
+        journalSaveProgress(written);
+    }
+    Serial.printf("[Fault] cut %u at point=%s offset=%u/%u\n", (unsigned)planIndex, pointNames[point],
+                  (unsigned)written, (unsigned)total);
+    Serial.flush();
+    ESP.restart();
+}
+
+#endif // OTA_FAULT_INJECT
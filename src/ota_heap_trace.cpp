@@ -0,0 +1,255 @@
+#ifdef OTA_HEAP_TRACE
+
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include "ota_heap_trace.h"
+
+// Size of the allocation record buffer. It is reused for every phase, so it only has to
+// hold the allocations of the busiest phase (the TLS handshake). Each record costs
+// 12 + 4 * OTA_HEAP_TRACE_DEPTH bytes of RAM. Override with -D OTA_HEAP_TRACE_RECORDS=N.
+#ifndef OTA_HEAP_TRACE_RECORDS
+#define OTA_HEAP_TRACE_RECORDS 128
+#endif
+
+// Number of callers kept per allocation (at most 4)
+#ifndef OTA_HEAP_TRACE_DEPTH
+#define OTA_HEAP_TRACE_DEPTH 4
+#endif
+
+static const char* const phaseNames[OTA_PHASE_COUNT] = {"dns", "tls", "headers", "body", "update"};
+
+struct AllocRecord {
+    void* ptr;
+    uint32_t size;
+    bool freed;
+    uint32_t callers[OTA_HEAP_TRACE_DEPTH];
+};
+
+static AllocRecord traceRecords[OTA_HEAP_TRACE_RECORDS];
+static size_t recordCount = 0;
+static bool recordsOverflowed = false;
+static volatile bool recording = false;
+// The allocator is called from every task, so the record buffer needs a lock
+static portMUX_TYPE recordLock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char* currentOperation = NULL;
+static int currentPhase = -1;
+static unsigned long phaseStartMs = 0;
+static size_t phaseStartFree = 0;
+static size_t phaseStartLow = 0;
+static size_t operationStartFree = 0;
+
+// --- Allocation hooks ---
+// The heaptrace environment links with -Wl,--wrap=malloc (and calloc, realloc, free and the
+// heap_caps_* variants used by mbedtls and the Wi-Fi driver), so every call to them from
+// another object file, including the precompiled Arduino core, lands in __wrap_*() below.
+// This works with the prebuilt core, which has ESP-IDF's own heap tracer disabled.
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+void* __real_heap_caps_malloc(size_t size, uint32_t caps);
+void* __real_heap_caps_calloc(size_t count, size_t size, uint32_t caps);
+void __real_heap_caps_free(void* ptr);
+}
+
+// Return addresses on Xtensa carry the caller's window size in the top two bits. Put back
+// the code region bits and step back onto the call instruction, like the panic handler does.
+static uint32_t codeAddress(void* returnAddress) {
+    uint32_t pc = (uint32_t)(uintptr_t)returnAddress;
+    if (pc & 0x80000000) {
+        pc = (pc & 0x3fffffff) | 0x40000000;
+    }
+    return pc - 3;
+}
+
+// Instruction RAM, ROM and flash code of the ESP32. Anything else means the walk left the stack.
+static bool isCode(uint32_t pc) {
+    return pc >= 0x40000000 && pc < 0x40400000;
+}
+
+// Fills `callers` with the return addresses above the __wrap_*() function that called us.
+// __builtin_return_address() needs a constant level, hence the unrolled steps.
+#define OTA_TRACE_CALLER(level)                                                   \
+    if (level - 2 < OTA_HEAP_TRACE_DEPTH) {                                      \
+        uint32_t pc = codeAddress(__builtin_return_address(level));              \
+        if (!isCode(pc)) {                                                        \
+            return;                                                               \
+        }                                                                         \
+        callers[level - 2] = pc;                                                  \
+    }
+
+static void __attribute__((noinline)) getCallers(uint32_t* callers) {
+    memset(callers, 0, sizeof(uint32_t) * OTA_HEAP_TRACE_DEPTH);
+    OTA_TRACE_CALLER(2)
+    OTA_TRACE_CALLER(3)
+    OTA_TRACE_CALLER(4)
+    OTA_TRACE_CALLER(5)
+}
+
+static void __attribute__((noinline)) recordAlloc(void* ptr, size_t size) {
+    if (!recording || ptr == NULL) {
+        return;
+    }
+    uint32_t callers[OTA_HEAP_TRACE_DEPTH];
+    getCallers(callers);
+
+    portENTER_CRITICAL(&recordLock);
+    // A wrapped function that calls another wrapped one (heap_caps_malloc() -> malloc() in
+    // some configurations) reports the block twice, inner call first. The outer call knows
+    // the real caller, so it replaces the record instead of adding one.
+    bool nested = recordCount > 0 && traceRecords[recordCount - 1].ptr == ptr && !traceRecords[recordCount - 1].freed;
+    if (nested || recordCount < OTA_HEAP_TRACE_RECORDS) {
+        AllocRecord& record = traceRecords[nested ? recordCount - 1 : recordCount++];
+        record.ptr = ptr;
+        record.size = size;
+        record.freed = false;
+        memcpy(record.callers, callers, sizeof(callers));
+    } else {
+        recordsOverflowed = true;
+    }
+    portEXIT_CRITICAL(&recordLock);
+}
+
+static void recordFree(void* ptr) {
+    if (!recording || ptr == NULL) {
+        return;
+    }
+    // free() ends up in heap_caps_free() too, so the same block can be reported twice.
+    // Only the newest record that is still held is marked.
+    portENTER_CRITICAL(&recordLock);
+    for (size_t i = recordCount; i > 0; i--) {
+        if (traceRecords[i - 1].ptr == ptr && !traceRecords[i - 1].freed) {
+            traceRecords[i - 1].freed = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&recordLock);
+}
+
+extern "C" {
+void* __wrap_malloc(size_t size) {
+    void* ptr = __real_malloc(size);
+    recordAlloc(ptr, size);
+    return ptr;
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    void* ptr = __real_calloc(count, size);
+    recordAlloc(ptr, count * size);
+    return ptr;
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    void* moved = __real_realloc(ptr, size);
+    if (moved != NULL || size == 0) {
+        recordFree(ptr);
+    }
+    recordAlloc(moved, size);
+    return moved;
+}
+
+void __wrap_free(void* ptr) {
+    recordFree(ptr);
+    __real_free(ptr);
+}
+
+void* __wrap_heap_caps_malloc(size_t size, uint32_t caps) {
+    void* ptr = __real_heap_caps_malloc(size, caps);
+    recordAlloc(ptr, size);
+    return ptr;
+}
+
+void* __wrap_heap_caps_calloc(size_t count, size_t size, uint32_t caps) {
+    void* ptr = __real_heap_caps_calloc(count, size, caps);
+    recordAlloc(ptr, count * size);
+    return ptr;
+}
+
+void __wrap_heap_caps_free(void* ptr) {
+    recordFree(ptr);
+    __real_heap_caps_free(ptr);
+}
+}
+
+// Prints every record of the phase that just ended, oldest first.
+static void dumpRecords() {
+    for (size_t i = 0; i < recordCount; i++) {
+        const AllocRecord& record = traceRecords[i];
+        Serial.printf("[Heap Trace] alloc op=%s phase=%s size=%u freed=%d callers=",
+                      currentOperation, phaseNames[currentPhase], (unsigned)record.size, record.freed ? 1 : 0);
+        for (int depth = 0; depth < OTA_HEAP_TRACE_DEPTH && record.callers[depth] != 0; depth++) {
+            Serial.printf("%s0x%08x", depth == 0 ? "" : ",", (unsigned)record.callers[depth]);
+        }
+        Serial.println();
+    }
+    if (recordsOverflowed) {
+        Serial.printf("[Heap Trace] overflow op=%s phase=%s records=%u (raise OTA_HEAP_TRACE_RECORDS)\n",
+                      currentOperation, phaseNames[currentPhase], (unsigned)recordCount);
+    }
+}
+
+void otaTraceBegin(const char* operation) {
+    otaTraceEnd();
+    currentOperation = operation;
+    operationStartFree = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    // The version lets perf_history.py check that a log belongs to the release it records
+    Serial.printf("[Heap Trace] begin op=%s version=%s free=%u\n", operation, FIRMWARE_VERSION,
+                  (unsigned)operationStartFree);
+}
+
+void otaTracePhaseStart(OtaPhase phase) {
+    if (currentOperation == NULL) {
+        return;
+    }
+    otaTracePhaseEnd();
+    currentPhase = phase;
+    phaseStartFree = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    phaseStartLow = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    phaseStartMs = millis();
+
+    // Records of blocks that are freed again stay in the buffer (marked freed), so
+    // short-lived buffers show up as well as the ones that are still held.
+    portENTER_CRITICAL(&recordLock);
+    recordCount = 0;
+    recordsOverflowed = false;
+    recording = true;
+    portEXIT_CRITICAL(&recordLock);
+}
+
+void otaTracePhaseEnd() {
+    if (currentPhase < 0) {
+        return;
+    }
+    // Stop before printing; Serial.printf() allocates too.
+    portENTER_CRITICAL(&recordLock);
+    recording = false;
+    portEXIT_CRITICAL(&recordLock);
+
+    unsigned long elapsed = millis() - phaseStartMs;
+    size_t freeNow = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    size_t lowNow = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+
+    // The low-water mark only moves when this phase set a new record, so `new_low=1` tells
+    // the report script that `heap_before - low` is the real peak of this phase.
+    Serial.printf("[Heap Trace] phase op=%s phase=%s ms=%lu heap_before=%u heap_after=%u low=%u new_low=%d\n",
+                  currentOperation, phaseNames[currentPhase], elapsed, (unsigned)phaseStartFree,
+                  (unsigned)freeNow, (unsigned)lowNow, lowNow < phaseStartLow ? 1 : 0);
+
+    dumpRecords();
+    currentPhase = -1;
+}
+
+void otaTraceEnd() {
+    if (currentOperation == NULL) {
+        return;
+    }
+    otaTracePhaseEnd();
+    size_t freeNow = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    Serial.printf("[Heap Trace] end op=%s free=%u retained=%d\n", currentOperation, (unsigned)freeNow,
+                  (int)operationStartFree - (int)freeNow);
+    currentOperation = NULL;
+}
+
+#endif // OTA_HEAP_TRACE
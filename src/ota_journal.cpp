@@ -0,0 +1,102 @@
+#include <Arduino.h>
+#include <Preferences.h>
+#include "ota_journal.h"
+
+// Journal entry state
+#define STATE_IDLE 0
+#define STATE_WRITING 1    // between Update.begin() and Update.end()
+#define STATE_ACTIVATED 2  // Update.end() succeeded, waiting for the new firmware to boot
+
+static Preferences journalStore;
+static uint32_t lastCheckpoint = 0;
+
+static void closeEntry(JournalResult result) {
+    journalStore.putUChar("result", result);
+    journalStore.putUChar("state", STATE_IDLE);
+}
+
+void journalBegin(const char* runningVersion) {
+    journalStore.begin("ota_journal", false);
+    uint8_t state = journalStore.getUChar("state", STATE_IDLE);
+    if (state == STATE_IDLE) {
+        return;
+    }
+
+    String from = journalStore.getString("from");
+    String to = journalStore.getString("to");
+    uint32_t size = journalStore.getUInt("size", 0);
+    uint32_t written = journalStore.getUInt("written", 0);
+
+    // Whatever state we were in, booting the target version means the update made it.
+    // This also covers a reset between Update.end() and the journal write.
+    if (to.equals(runningVersion)) {
+        Serial.printf("[OTA Recovery] update %s -> %s completed, running %s: ok\n",
+                      from.c_str(), to.c_str(), runningVersion);
+        closeEntry(JOURNAL_OK);
+        return;
+    }
+
+    // Otherwise we must be back on the version we started from; anything else is a bad boot.
+    int recovered = from.equals(runningVersion) ? 1 : 0;
+    if (state == STATE_ACTIVATED) {
+        Serial.printf("[OTA Recovery] update %s -> %s rolled back, running %s: recovered=%d\n",
+                      from.c_str(), to.c_str(), runningVersion, recovered);
+        closeEntry(JOURNAL_ROLLED_BACK);
+        return;
+    }
+
+    // The updater always downloads from byte 0, so every byte written before the
+    // interruption is downloaded again.
+    Serial.printf("[OTA Recovery] interrupted update %s -> %s at %u/%u bytes, running %s: recovered=%d redownload=%u\n",
+                  from.c_str(), to.c_str(), (unsigned)written, (unsigned)size, runningVersion, recovered,
+                  (unsigned)written);
+    closeEntry(JOURNAL_INTERRUPTED);
+}
+
+void journalStart(const char* fromVersion, const String& toVersion, uint32_t imageSize) {
+    journalStore.putString("from", fromVersion);
+    journalStore.putString("to", toVersion);
+    journalStore.putUInt("size", imageSize);
+    journalStore.putUInt("written", 0);
+    journalStore.putUChar("state", STATE_WRITING);
+    lastCheckpoint = 0;
+}
+
+void journalProgress(uint32_t written) {
+    if (written - lastCheckpoint >= JOURNAL_CHECKPOINT) {
+        // Round down to the checkpoint, so the journal never claims more than was written.
+        journalSaveProgress(written - written % JOURNAL_CHECKPOINT);
+    }
+}
+
+void journalSaveProgress(uint32_t written) {
+    lastCheckpoint = written;
+    journalStore.putUInt("written", written);
+}
+
+void journalFinish(bool success, uint32_t bytesPerSecond) {
+    journalStore.putUInt("bps", bytesPerSecond);
+    if (success) {
+        journalStore.putUChar("state", STATE_ACTIVATED);
+    } else {
+        closeEntry(JOURNAL_FAILED);
+    }
+}
+
+JournalResult journalLastResult() {
+    return (JournalResult)journalStore.getUChar("result", JOURNAL_NONE);
+}
+
+uint32_t journalLastThroughput() {
+    return journalStore.getUInt("bps", 0);
+}
+
+const char* journalResultName(JournalResult result) {
+    switch (result) {
+        case JOURNAL_OK: return "ok";
+        case JOURNAL_FAILED: return "failed";
+        case JOURNAL_INTERRUPTED: return "interrupted";
+        case JOURNAL_ROLLED_BACK: return "rolled_back";
+        default: return "none";
+    }
+}
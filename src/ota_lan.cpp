@@ -0,0 +1,162 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include "ota_budget.h"
+#include "ota_lan.h"
+
+enum LanRole {
+    LAN_FOLLOWER,
+    LAN_CANDIDATE,
+    LAN_LEADER
+};
+
+static WiFiUDP udp;
+static bool started = false;
+static uint16_t lanPort = 0;
+static uint64_t myId = 0;
+
+static LanRole role = LAN_FOLLOWER;
+static unsigned long roleSince = 0;       // when we entered the current role
+static unsigned long lastLeaderSeen = 0;  // follower: last heartbeat (or higher claim) heard
+static unsigned long lastHeartbeat = 0;   // leader: last heartbeat sent
+static unsigned long electionDelay = 0;   // follower: random extra wait before claiming
+
+// Leader: the version we fetched. Follower: the version the leader announced.
+static String knownVersion;
+static unsigned long versionHeardAt = 0;
+static unsigned long updateDelay = 0;
+
+static void send(const char* type, const char* version) {
+    char message[64];
+    snprintf(message, sizeof(message), "OTA1 %s %04x%08x %s", type, (unsigned)(myId >> 32), (unsigned)myId, version);
+    udp.beginPacket(WiFi.broadcastIP(), lanPort);
+    udp.write((const uint8_t*)message, strlen(message));
+    udp.endPacket();
+}
+
+static void sendHeartbeat() {
+    // The day rides along so that followers can roll their data budget over (see ota_budget.h)
+    char payload[48];
+    snprintf(payload, sizeof(payload), "%s %u", knownVersion.length() > 0 ? knownVersion.c_str() : "-",
+             (unsigned)budgetDay());
+    send("LEADER", payload);
+    lastHeartbeat = millis();
+}
+
+static void becomeFollower(const char* reason) {
+    if (role != LAN_FOLLOWER) {
+        Serial.printf("[LAN] Following (%s).\n", reason);
+    }
+    role = LAN_FOLLOWER;
+    roleSince = millis();
+    lastLeaderSeen = millis();
+    // Spread the next election so that not every follower claims at the same moment
+    electionDelay = esp_random() % 1000;
+}
+
+static void handleMessage(const char* type, uint64_t id, const char* version, uint32_t day) {
+    if (strcmp(type, "LEADER") == 0) {
+        if (role == LAN_LEADER && id < myId) {
+            sendHeartbeat();  // we outrank it; it steps down when it hears us
+            return;
+        }
+        becomeFollower("leader heard");
+        budgetSetLeaderDay(day);
+        if (strcmp(version, "-") != 0 && !knownVersion.equals(version)) {
+            knownVersion = version;
+            versionHeardAt = millis();
+            updateDelay = esp_random() % LAN_UPDATE_JITTER_MS;
+            Serial.printf("[LAN] Leader announced version %s, updating in %lu s if needed.\n", version,
+                          updateDelay / 1000);
+        }
+    } else if (strcmp(type, "CLAIM") == 0) {
+        if (role == LAN_LEADER) {
+            sendHeartbeat();  // there is a leader already
+        } else if (id > myId) {
+            // A stronger candidate is running; give it a full timeout to send its first heartbeat.
+            becomeFollower("higher claim heard");
+        }
+    }
+}
+
+void lanBegin(uint16_t port) {
+    lanPort = port;
+    myId = ESP.getEfuseMac();
+    udp.begin(port);
+    started = true;
+    role = LAN_CANDIDATE;  // so becomeFollower() does not log
+    becomeFollower("startup");
+    Serial.printf("[LAN] Listening on UDP port %u for a leader.\n", port);
+}
+
+void lanLoop() {
+    if (!started) {
+        return;
+    }
+
+    // Drain every datagram that arrived since the last call
+    while (udp.parsePacket() > 0) {
+        char message[64];
+        int length = udp.read((uint8_t*)message, sizeof(message) - 1);
+        if (length <= 0) {
+            continue;
+        }
+        message[length] = '\0';
+
+        char type[8];
+        char idHex[17];
+        char version[32] = "-";
+        unsigned day = 0;
+        if (sscanf(message, "OTA1 %7s %16s %31s %u", type, idHex, version, &day) < 2) {
+            continue;
+        }
+        uint64_t id = strtoull(idHex, NULL, 16);
+        if (id != myId) {
+            handleMessage(type, id, version, day);
+        }
+    }
+
+    unsigned long now = millis();
+    switch (role) {
+        case LAN_FOLLOWER:
+            if (now - lastLeaderSeen >= LAN_LEADER_TIMEOUT_MS + electionDelay) {
+                Serial.println("[LAN] No leader heard, claiming leadership...");
+                role = LAN_CANDIDATE;
+                roleSince = now;
+                send("CLAIM", "-");
+            }
+            break;
+        case LAN_CANDIDATE:
+            if (now - roleSince >= LAN_ELECTION_MS) {
+                Serial.println("[LAN] Elected leader, polling upstream for this segment.");
+                role = LAN_LEADER;
+                roleSince = now;
+                sendHeartbeat();
+            }
+            break;
+        case LAN_LEADER:
+            if (now - lastHeartbeat >= LAN_HEARTBEAT_MS) {
+                sendHeartbeat();
+            }
+            break;
+    }
+}
+
+bool lanIsLeader() {
+    return role == LAN_LEADER;
+}
+
+void lanAnnounce(const String& version) {
+    if (!started || role != LAN_LEADER || knownVersion.equals(version)) {
+        return;
+    }
+    knownVersion = version;
+    sendHeartbeat();
+}
+
+String lanAnnouncedVersion() {
+    if (role != LAN_FOLLOWER || knownVersion.length() == 0 || millis() - versionHeardAt < updateDelay) {
+        return String();
+    }
+    return knownVersion;
+}
@@ -0,0 +1,179 @@
+#include <Arduino.h>
+#include <Preferences.h>
+#include <mbedtls/ecdsa.h>
+#include <mbedtls/md.h>
+#include <mbedtls/pk.h>
+#include "ota_assets.h"
+#include "ota_manifest.h"
+
+// Decodes `hex` into `out`. Returns the number of bytes, or 0 if it is not valid hex or too long.
+static size_t fromHex(const String& hex, uint8_t* out, size_t outSize) {
+    if (hex.length() % 2 != 0 || hex.length() / 2 > outSize) {
+        return 0;
+    }
+    for (size_t i = 0; i < hex.length() / 2; i++) {
+        char pair[3] = {hex.charAt(2 * i), hex.charAt(2 * i + 1), '\0'};
+        char* end;
+        out[i] = (uint8_t)strtoul(pair, &end, 16);
+        if (*end != '\0') {
+            return 0;
+        }
+    }
+    return hex.length() / 2;
+}
+
+// Value of the "key=" line in `text`, or an empty String.
+static String field(const String& text, const char* key) {
+    String prefix = String(key) + "=";
+    int start = text.startsWith(prefix) ? 0 : text.indexOf("\n" + prefix);
+    if (start < 0) {
+        return String();
+    }
+    if (start > 0) {
+        start++;  // skip the newline
+    }
+    start += prefix.length();
+    int end = text.indexOf('\n', start);
+    String value = text.substring(start, end < 0 ? text.length() : end);
+    value.trim();
+    return value;
+}
+
+static bool verifySignature(const String& signedPart, const uint8_t* signature, size_t signatureLength) {
+    size_t keySize;
+    const uint8_t* key = assetGet(MANIFEST_KEY_ASSET, &keySize);
+    if (key == NULL) {
+        Serial.println("[Manifest] No signing key embedded (assets/" MANIFEST_KEY_ASSET "), refusing the update.");
+        return false;
+    }
+
+    // mbedtls wants PEM keys NUL terminated, with the terminator counted in the length
+    char* pem = (char*)malloc(keySize + 1);
+    if (pem == NULL) {
+        return false;
+    }
+    memcpy(pem, key, keySize);
+    pem[keySize] = '\0';
+
+    uint8_t hash[32];
+    mbedtls_md(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), (const unsigned char*)signedPart.c_str(),
+               signedPart.length(), hash);
+
+    mbedtls_pk_context publicKey;
+    mbedtls_pk_init(&publicKey);
+    int result = mbedtls_pk_parse_public_key(&publicKey, (const unsigned char*)pem, keySize + 1);
+    if (result == 0) {
+        result = mbedtls_pk_verify(&publicKey, MBEDTLS_MD_SHA256, hash, sizeof(hash), signature, signatureLength);
+    }
+    mbedtls_pk_free(&publicKey);
+    free(pem);
+
+    if (result != 0) {
+        Serial.printf("[Manifest] Signature check failed (mbedtls error -0x%04x).\n", (unsigned)-result);
+        return false;
+    }
+    return true;
+}
+
+bool manifestVerify(const String& text, OtaManifest& manifest) {
+    // Everything before the "sig=" line is signed, including its trailing newline
+    int sigLine = text.indexOf("\nsig=");
+    if (sigLine < 0) {
+        Serial.println("[Manifest] Manifest is not signed.");
+        return false;
+    }
+    String signedPart = text.substring(0, sigLine + 1);
+
+    uint8_t signature[MBEDTLS_ECDSA_MAX_LEN];
+    size_t signatureLength = fromHex(field(text, "sig"), signature, sizeof(signature));
+    if (signatureLength == 0 || !verifySignature(signedPart, signature, signatureLength)) {
+        return false;
+    }
+
+    // Only read the fields once we know they are genuine
+    manifest.version = field(signedPart, "version");
+    manifest.seq = strtoul(field(signedPart, "seq").c_str(), NULL, 10);
+    manifest.size = field(signedPart, "size").toInt();
+    if (manifest.version.length() == 0 || manifest.seq == 0 || manifest.size == 0 ||
+        fromHex(field(signedPart, "sha256"), manifest.sha256, sizeof(manifest.sha256)) != sizeof(manifest.sha256)) {
+        Serial.println("[Manifest] Signed manifest is missing version, seq, size or sha256.");
+        return false;
+    }
+
+    // A genuine but older manifest is a replay. Remember the newest one we have seen.
+    Preferences store;
+    store.begin("ota_manifest", false);
+    uint32_t newest = store.getUInt("seq", 0);
+    if (manifest.seq < newest) {
+        Serial.printf("[Manifest] Manifest seq %u is older than %u seen before, ignoring it.\n",
+                      (unsigned)manifest.seq, (unsigned)newest);
+        store.end();
+        return false;
+    }
+    if (manifest.seq > newest) {
+        store.putUInt("seq", manifest.seq);
+    }
+    store.end();
+    return true;
+}
+
+int manifestVersionCompare(const String& a, const String& b) {
+    // Walk both strings one numeric component at a time; a missing component counts as 0
+    const char* pa = a.c_str();
+    const char* pb = b.c_str();
+    while (*pa != '\0' || *pb != '\0') {
+        char* endA;
+        char* endB;
+        unsigned long na = strtoul(pa, &endA, 10);
+        unsigned long nb = strtoul(pb, &endB, 10);
+        if (na != nb) {
+            return na < nb ? -1 : 1;
+        }
+        pa = *endA != '\0' ? endA + 1 : endA;
+        pb = *endB != '\0' ? endB + 1 : endB;
+    }
+    return 0;
+}
+
+Sha256Stream::Sha256Stream(Stream& source) : source(source) {
+    mbedtls_md_init(&context);
+    mbedtls_md_setup(&context, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 0);
+    mbedtls_md_starts(&context);
+}
+
+Sha256Stream::~Sha256Stream() {
+    mbedtls_md_free(&context);
+}
+
+int Sha256Stream::available() {
+    return source.available();
+}
+
+int Sha256Stream::read() {
+    int c = source.read();
+    if (c >= 0) {
+        uint8_t byte = c;
+        mbedtls_md_update(&context, &byte, 1);
+    }
+    return c;
+}
+
+int Sha256Stream::peek() {
+    return source.peek();
+}
+
+// Updater::writeStream() reads in blocks. Hashing the whole block here is much faster than
+// going through read() one byte at a time.
+size_t Sha256Stream::readBytes(char* buffer, size_t length) {
+    size_t count = source.readBytes(buffer, length);
+    mbedtls_md_update(&context, (const unsigned char*)buffer, count);
+    return count;
+}
+
+size_t Sha256Stream::write(uint8_t) {
+    return 0;
+}
+
+void Sha256Stream::finish(uint8_t* digest) {
+    mbedtls_md_finish(&context, digest);
+}
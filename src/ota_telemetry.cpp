@@ -0,0 +1,34 @@
+#include <Arduino.h>
+#include "ota_journal.h"
+#include "ota_telemetry.h"
+
+// Appends ";key=value" to `summary` if it fits whole within TELEMETRY_MAX_LENGTH.
+// A field that does not fit is left out instead of being cut, so a gateway never sees
+// a shortened number (up=8 instead of up=86400) that still looks valid.
+static void appendField(String& summary, const char* key, const String& value) {
+    size_t length = summary.length() + (summary.length() > 0 ? 1 : 0) + strlen(key) + 1 + value.length();
+    if (length > TELEMETRY_MAX_LENGTH) {
+        return;
+    }
+    if (summary.length() > 0) {
+        summary += ';';
+    }
+    summary += key;
+    summary += '=';
+    summary += value;
+}
+
+String telemetrySummary(const char* version) {
+    char id[13];
+    uint64_t mac = ESP.getEfuseMac();
+    snprintf(id, sizeof(id), "%04x%08x", (unsigned)(mac >> 32), (unsigned)mac);
+
+    String summary;
+    appendField(summary, "id", id);
+    appendField(summary, "v", version);
+    appendField(summary, "r", journalResultName(journalLastResult()));
+    appendField(summary, "tp", String((unsigned)journalLastThroughput()));
+    appendField(summary, "hm", String((unsigned)ESP.getMinFreeHeap()));
+    appendField(summary, "up", String(millis() / 1000));
+    return summary;
+}
@@ -0,0 +1,77 @@
+#include <Arduino.h>
+#include "ota_version_tag.h"
+
+// The tag of this build. The constructor below reads it through a volatile pointer, so the
+// compiler cannot fold it away and --gc-sections keeps it in every image.
+const char otaVersionTag[] = OTA_VERSION_TAG_PREFIX FIRMWARE_VERSION;
+
+VersionTagStream::VersionTagStream(Stream& source, const String& version) : source(source) {
+    size_t prefixLength = sizeof(OTA_VERSION_TAG_PREFIX) - 1;
+    if (version.length() == 0 || version.length() > OTA_VERSION_TAG_MAX) {
+        return;  // nothing to look for; found() stays false
+    }
+    // "OTA_FW_VERSION=1.0.4\0": the NUL keeps 1.0.4 from matching inside 1.0.41
+    const volatile char* tag = otaVersionTag;
+    for (size_t i = 0; i < prefixLength; i++) {
+        pattern[i] = tag[i];
+    }
+    memcpy(pattern + prefixLength, version.c_str(), version.length());
+    pattern[prefixLength + version.length()] = '\0';
+    patternLength = prefixLength + version.length() + 1;
+
+    // Knuth-Morris-Pratt fallback table, so a tag split across two reads is still found
+    fallback[0] = 0;
+    size_t k = 0;
+    for (size_t i = 1; i < patternLength; i++) {
+        while (k > 0 && pattern[i] != pattern[k]) {
+            k = fallback[k - 1];
+        }
+        if (pattern[i] == pattern[k]) {
+            k++;
+        }
+        fallback[i] = k;
+    }
+}
+
+void VersionTagStream::scan(uint8_t byte) {
+    if (tagFound || patternLength == 0) {
+        return;
+    }
+    while (matched > 0 && byte != pattern[matched]) {
+        matched = fallback[matched - 1];
+    }
+    if (byte == pattern[matched]) {
+        matched++;
+    }
+    if (matched == patternLength) {
+        tagFound = true;
+    }
+}
+
+int VersionTagStream::available() {
+    return source.available();
+}
+
+int VersionTagStream::read() {
+    int c = source.read();
+    if (c >= 0) {
+        scan(c);
+    }
+    return c;
+}
+
+int VersionTagStream::peek() {
+    return source.peek();
+}
+
+size_t VersionTagStream::readBytes(char* buffer, size_t length) {
+    size_t count = source.readBytes(buffer, length);
+    for (size_t i = 0; i < count; i++) {
+        scan(buffer[i]);
+    }
+    return count;
+}
+
+size_t VersionTagStream::write(uint8_t) {
+    return 0;
+}